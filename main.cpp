@@ -15,29 +15,123 @@
 #include "httplib.hpp"
 #include "json.hpp"
 
+#include <arpa/nameser.h>
+#include <csignal>
+#include <fcntl.h>
+#include <resolv.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <coroutine>
+#include <cstring>
 #include <ctime>
+#include <deque>
+#include <filesystem>
+#include <fstream>
 #include <future>
+#include <iomanip>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <random>
 #include <regex>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
 #define CA_CERT_FILE "./ca-bundle.crt"
 
-using json = nlohmann::json;
+//Counts the heap allocations for countingJson values (objects, arrays,
+//strings) made on the calling thread while it exists. The test command
+//uses it to check that extracting the posts never deep copies the DOM.
+class jsonAllocationCounter
+{
+public:
+    jsonAllocationCounter() :
+        _previous(std::exchange(_current, this)) {};
+    ~jsonAllocationCounter() { _current = _previous; }
+    jsonAllocationCounter(const jsonAllocationCounter &) = delete;
+    jsonAllocationCounter &operator=(const jsonAllocationCounter &) = delete;
+
+    [[nodiscard]] size_t allocations() const { return _allocations; }
+
+    static void count()
+    {
+        if (_current)
+            ++_current->_allocations;
+    }
 
-//wrapper function for checking whether a task has finished and
-//the result can be retrieved by a std::future
-template <typename R>
-bool isReady(const std::future<R> &f)
+private:
+    static inline thread_local jsonAllocationCounter *_current = nullptr;
+    jsonAllocationCounter *_previous;
+    size_t _allocations {0};
+};
+
+template <typename T>
+struct countingAllocator
 {
-    return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
-}
+    using value_type = T;
+
+    countingAllocator() = default;
+    template <typename U>
+    explicit countingAllocator(const countingAllocator<U> &) {};
+
+    T *allocate(size_t n)
+    {
+        jsonAllocationCounter::count();
+        return std::allocator<T>().allocate(n);
+    }
+    void deallocate(T *p, size_t n) { std::allocator<T>().deallocate(p, n); }
+
+    template <typename U>
+    bool operator==(const countingAllocator<U> &) const { return true; }
+};
+
+using json = nlohmann::json;
+//the same DOM, counting its allocations, for the test command only
+using countingJson = nlohmann::basic_json<std::map, std::vector, std::string, bool, std::int64_t, std::uint64_t, double, countingAllocator>;
 
 struct Post
 {
+    //the strings are allocated from the run arena when the Post is created in
+    //a std::pmr container, see runArena.
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+    Post() = default;
+    Post(const Post &) = default;
+    Post(Post &&) noexcept = default;
+    Post &operator=(const Post &) = default;
+    Post &operator=(Post &&) noexcept = default;
+    explicit Post(const allocator_type &alloc) :
+        id(alloc), title(alloc), original_url(alloc), submitter(alloc), comment_url(alloc) {};
+    Post(const Post &other, const allocator_type &alloc) :
+        id(other.id, alloc), submit_timestamp(other.submit_timestamp), title(other.title, alloc),
+        original_url(other.original_url, alloc), submitter(other.submitter, alloc),
+        comment_url(other.comment_url, alloc), votes(other.votes), comment_count(other.comment_count) {};
+    Post(Post &&other, const allocator_type &alloc) :
+        id(std::move(other.id), alloc), submit_timestamp(other.submit_timestamp), title(std::move(other.title), alloc),
+        original_url(std::move(other.original_url), alloc), submitter(std::move(other.submitter), alloc),
+        comment_url(std::move(other.comment_url), alloc), votes(other.votes), comment_count(other.comment_count) {};
+
     friend std::ostream &operator<<(std::ostream &os, const Post &post)
     {
 
@@ -45,18 +139,26 @@ struct Post
         return os;
     }
     static std::string printDateTimeLocal(const Post &post)
+    {
+        return printDateTimeLocal(post.submit_timestamp);
+    }
+    static std::string printDateTimeLocal(time_t submit_timestamp)
     {
         char _submit_date[200] {""};
         tm _localTime {0};
-        _localTime = *localtime(&post.submit_timestamp);
+        _localTime = *localtime(&submit_timestamp);
         strftime(_submit_date, sizeof(_submit_date), "%Y-%m-%dT%H:%M:%S %z", &_localTime);
         return std::string(_submit_date);
     }
     static std::string printDateTimeUTC(const Post &post)
+    {
+        return printDateTimeUTC(post.submit_timestamp);
+    }
+    static std::string printDateTimeUTC(time_t submit_timestamp)
     {
         char _submit_date[200] {""};
         tm _utcTime {0};
-        _utcTime = *gmtime(&post.submit_timestamp);
+        _utcTime = *gmtime(&submit_timestamp);
         strftime(_submit_date, sizeof(_submit_date), "%Y-%m-%dT%H:%M:%S %z", &_utcTime);
         return std::string(_submit_date);
     }
@@ -68,12 +170,12 @@ struct Post
     {
         return printDateTimeLocal(*this);
     }
-    std::string id;
+    std::pmr::string id;
     time_t submit_timestamp {0};
-    std::string title;
-    std::string original_url;
-    std::string submitter;
-    std::string comment_url;
+    std::pmr::string title;
+    std::pmr::string original_url;
+    std::pmr::string submitter;
+    std::pmr::string comment_url;
     int votes {};
     int comment_count {};
     bool operator<(const Post &rhs) const
@@ -107,395 +209,5018 @@ struct Post
     }
 };
 
-class httpException : public std::runtime_error
+//Per run monotonic arena. The parsed posts, interned strings, url indexes
+//and match records of a run are allocated from it and released together.
+//The first block is preallocated and reused after reset(), so repeated runs
+//in one process stay within it unless a single run outgrows it.
+class runArena
 {
 public:
-    explicit httpException(const std::string &msg) :
-        std::runtime_error(msg)
-    {
-    }
+    explicit runArena(size_t size = 8 * 1024 * 1024) :
+        _buffer(std::make_unique_for_overwrite<std::byte[]>(size)), _resource(_buffer.get(), size) {};
+
+    std::pmr::memory_resource *resource() { return &_resource; }
+    void reset() { _resource.release(); }
+
+private:
+    std::unique_ptr<std::byte[]> _buffer;
+    std::pmr::monotonic_buffer_resource _resource;
 };
 
-class aggregator
+//Interns strings into blocks taken from the given memory resource. The
+//returned views stay valid for the lifetime of the pool (also when the pool
+//is moved), so equal strings are stored once and can be compared and hashed
+//without owning a copy.
+class stringPool
 {
 public:
-    virtual std::vector<Post> parsePosts(nlohmann::json posts) = 0;
-    virtual json getPosts() = 0;
+    explicit stringPool(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) :
+        _blocks(std::make_unique<std::pmr::monotonic_buffer_resource>(64 * 1024, resource)), _interned(resource) {};
 
-    static json getJson(const std::string &domain, const std::string &url)
+    std::string_view intern(std::string_view str)
     {
-        httplib::SSLClient cli(domain);
-        cli.enable_server_certificate_verification(false);
-        httplib::Headers headers = {};
-        if (auto res = cli.Get(url.c_str()))
-        {
-            if (res->status != 200)
-                throw httpException("HTTP Request failed. domain='" + domain + "', url='" + url + "', status code='" + std::to_string(res->status) + "', reason='" + res->reason + "'");
-
-            auto result = json::parse(res->body);
-            return result;
-        }
-        else
-        {
-            std::string sslError;
-            if (auto result = cli.get_openssl_verify_result())
-                sslError += X509_verify_cert_error_string(result);
+        // allocate(0) may return any pointer, an empty view needs no storage
+        if (str.empty())
+            return {};
+        if (auto interned = _interned.find(str); interned != _interned.end())
+            return *interned;
 
-            throw httpException("HTTP Request failed. domain='" + domain + "', url='" + url + "', httplib error='" + std::to_string((int)res.error()) + "', " + sslError);
-        }
+        auto *dest = static_cast<char *>(_blocks->allocate(str.size(), 1));
+        std::copy(str.begin(), str.end(), dest);
+        std::string_view stored {dest, str.size()};
+        _interned.insert(stored);
+        return stored;
     }
+
+private:
+    std::unique_ptr<std::pmr::monotonic_buffer_resource> _blocks;
+    std::pmr::unordered_set<std::string_view> _interned;
 };
 
-class lobsters : public aggregator
+//Column oriented storage of posts for the analysis. The scalars are kept in
+//contiguous arrays and the strings are interned views, so the matching and
+//reporting code can work on row numbers instead of copying whole Posts.
+class PostTable
 {
 public:
-    explicit lobsters(std::string domain, std::string url) :
-        _domain(std::move(domain)), _url(std::move(url)) {};
-    std::vector<Post> parsePosts(json posts) override
-    {
-        std::vector<Post> result;
-        for (const auto &page : posts)
-        {
-            for (const auto &item : page)
-            {
-                if (!item.contains("url"))
-                    continue;
-
-                Post p;
-                if (item.contains("comment_count"))
-                    p.comment_count = item["comment_count"];
-                if (item.contains("comments_url"))
-                    p.comment_url = item["comments_url"];
-                if (item.contains("score"))
-                    p.votes = item["score"];
-                if (item.contains("title"))
-                    p.title = item["title"];
-                if (item.contains("url"))
-                    p.original_url = item["url"];
-                if (item.contains("short_id"))
-                    p.id = item["short_id"];
-                if (item.contains("created_at"))
-                {
-                    // format: 2020-12-28T00:22:26.000-06:00
-                    std::string dateStr = item["created_at"];
-                    // %z doesnt like the colon in the timezone
-                    dateStr.erase(dateStr.begin() + 26);
-                    struct tm cst
-                    {
-                        0
-                    };
-                    auto lobsters_convert = strptime(dateStr.c_str(), "%Y-%m-%dT%H:%M:%S.000%z", &cst);
-                    if (lobsters_convert && lobsters_convert[0]) // strptime failed to convert
-                        continue;
-
-                    // timegm updates the static storage, copy it first.
-                    auto lobsters_utc_offset = cst.tm_gmtoff; // gcc extension
-                    time_t lobsters_epoch_without_timezone_offset = timegm(&cst); // epoch is in utc, so use timegm instead of mktime
-                    time_t lobsters_epoch = difftime(lobsters_epoch_without_timezone_offset, lobsters_utc_offset);
-                    p.submit_timestamp = lobsters_epoch;
-                }
+    explicit PostTable(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) :
+        _strings(resource), _id(resource), _submit_timestamp(resource), _title(resource), _original_url(resource),
+        _submitter(resource), _comment_url(resource), _votes(resource), _comment_count(resource) {};
 
-                if (item.contains("submitter_user"))
-                    for (auto &[key, value] : item["submitter_user"].items())
-                        if (key == "username")
-                            p.submitter = value;
+    //uses the memory resource of the posts, normally the run arena
+    explicit PostTable(const std::pmr::vector<Post> &posts) :
+        PostTable(posts.get_allocator().resource())
+    {
+        reserve(posts.size());
+        for (const auto &post : posts)
+            add(post);
+    }
 
-                result.push_back(p);
-            }
-        }
-        return result;
+    void reserve(size_t rows)
+    {
+        _id.reserve(rows);
+        _submit_timestamp.reserve(rows);
+        _title.reserve(rows);
+        _original_url.reserve(rows);
+        _submitter.reserve(rows);
+        _comment_url.reserve(rows);
+        _votes.reserve(rows);
+        _comment_count.reserve(rows);
     }
 
-    json getPosts() override
+    size_t add(const Post &post)
     {
-        json posts {};
-        std::vector<std::future<json>> futures;
-        int maxPages = 9;
-        // Queue up all the items,
-        for (int i = 1; i < maxPages; ++i)
-        {
-            std::string postUrl = std::regex_replace(_url, std::regex("%PAGENUMBER%"), std::to_string(i));
-            futures.push_back(std::async(std::launch::async, getJson, _domain, postUrl));
-        }
+        _id.push_back(_strings.intern(post.id));
+        _submit_timestamp.push_back(post.submit_timestamp);
+        _title.push_back(_strings.intern(post.title));
+        _original_url.push_back(_strings.intern(post.original_url));
+        _submitter.push_back(_strings.intern(post.submitter));
+        _comment_url.push_back(_strings.intern(post.comment_url));
+        _votes.push_back(post.votes);
+        _comment_count.push_back(post.comment_count);
+        return _id.size() - 1;
+    }
 
-        // Wait until all futures are finished
-        int finishedFutures = 1;
-        while (finishedFutures < maxPages)
-        {
-            for (const auto &future : futures)
-            {
-                if (isReady(future))
-                    ++finishedFutures;
-            }
-        }
+    [[nodiscard]] size_t size() const { return _id.size(); }
+    [[nodiscard]] std::pmr::memory_resource *resource() const { return _id.get_allocator().resource(); }
+    [[nodiscard]] std::string_view id(size_t row) const { return _id[row]; }
+    [[nodiscard]] time_t submit_timestamp(size_t row) const { return _submit_timestamp[row]; }
+    [[nodiscard]] std::string_view title(size_t row) const { return _title[row]; }
+    [[nodiscard]] std::string_view original_url(size_t row) const { return _original_url[row]; }
+    [[nodiscard]] std::string_view submitter(size_t row) const { return _submitter[row]; }
+    [[nodiscard]] std::string_view comment_url(size_t row) const { return _comment_url[row]; }
+    [[nodiscard]] int votes(size_t row) const { return _votes[row]; }
+    [[nodiscard]] int comment_count(size_t row) const { return _comment_count[row]; }
 
-        for (auto &future : futures)
-        {
-            posts.push_back(future.get());
-        }
+private:
+    stringPool _strings;
+    std::pmr::vector<std::string_view> _id;
+    std::pmr::vector<time_t> _submit_timestamp;
+    std::pmr::vector<std::string_view> _title;
+    std::pmr::vector<std::string_view> _original_url;
+    std::pmr::vector<std::string_view> _submitter;
+    std::pmr::vector<std::string_view> _comment_url;
+    std::pmr::vector<int> _votes;
+    std::pmr::vector<int> _comment_count;
+};
 
-        return posts;
+class httpException : public std::runtime_error
+{
+public:
+    explicit httpException(const std::string &msg) :
+        std::runtime_error(msg)
+    {
     }
-
-private:
-    std::string _url;
-    std::string _domain;
 };
 
-class hackernews : public aggregator
+//a request that the run's time budget ended before it had a response
+class budgetExpired : public httpException
 {
 public:
-    explicit hackernews(std::string domain, std::string id_url, std::string story_url) :
-        _domain(std::move(domain)), _id_url(std::move(id_url)), _story_url(std::move(story_url)) {};
+    using httpException::httpException;
+};
 
-    std::vector<Post> parsePosts(json posts) override
-    {
-        std::vector<Post> result;
-        for (const auto &item : posts)
-        {
-            bool isStory = (item.contains("type") && item["type"].get<std::string>() == "story");
-            if (!isStory)
-                continue;
-            if (!item.contains("url"))
-                continue;
+//raw upstream response, kept separate from the json so it can be recorded
+//and replayed byte for byte.
+struct httpResponse
+{
+    int status {0}; // 0 means the request never got an http response
+    std::string reason;
+    httplib::Headers headers;
+    std::string body;
+    std::chrono::microseconds elapsed {0};
+    bool permanent {false}; // failed in a way a retry won't fix, not archived
+    bool outOfTime {false}; // ended by the run's time budget (--budget), not archived
+};
 
-            Post p;
-            if (item.contains("descendants"))
-                p.comment_count = item["descendants"];
-            if (item.contains("score"))
-                p.votes = item["score"];
-            if (item.contains("title"))
-                p.title = item["title"];
-            if (item.contains("url"))
-                p.original_url = item["url"];
-            if (item.contains("by"))
-                p.submitter = item["by"];
-            if (item.contains("id"))
-            {
-                p.id = std::to_string(item["id"].get<long long>());
-                p.comment_url = "https://news.ycombinator.com/item?id=" + p.id;
-            }
-            if (item.contains("time"))
-            {
-                // format: 1609012592 (epoch) (epoch is always utc)
-                std::string dateStr = std::to_string(item["time"].get<long long>());
-                time_t hn_epoch = std::stoll(dateStr);
-                p.submit_timestamp = hn_epoch;
-            }
+//small helpers for the binary files written by this program (native endianness)
+template <typename T>
+void writeValue(std::ostream &os, const T &value)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    os.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
 
-            result.push_back(p);
-        }
+template <typename T>
+T readValue(std::istream &is)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    T value {};
+    is.read(reinterpret_cast<char *>(&value), sizeof(T));
+    return value;
+}
 
-        return result;
+void writeString(std::ostream &os, const std::string &str)
+{
+    writeValue<uint32_t>(os, str.size());
+    os.write(str.data(), str.size());
+}
+
+std::string readString(std::istream &is)
+{
+    std::string str(readValue<uint32_t>(is), '\0');
+    is.read(str.data(), str.size());
+    return str;
+}
+
+//--record=dir writes every upstream response to dir/traffic.dat, with
+//dir/traffic.idx mapping "domain+url" to the record offset. --replay=dir
+//serves those responses back without touching the network, in the order
+//they were recorded when the same url was requested more than once.
+class trafficArchive
+{
+public:
+    void startRecording(const std::string &dir)
+    {
+        std::filesystem::create_directories(dir);
+        _data.open(std::filesystem::path(dir) / "traffic.dat", std::ios::binary | std::ios::trunc);
+        _index.open(std::filesystem::path(dir) / "traffic.idx", std::ios::binary | std::ios::trunc);
+        if (!_data || !_index)
+            throw std::runtime_error("Cannot open traffic archive for writing in '" + dir + "'");
+        _recording = true;
     }
 
-    json getPosts() override
+    void startReplaying(const std::string &dir)
     {
-        json posts {};
-        std::vector<std::future<json>> futures;
-        int counter = 1;
-        int maxPosts = 200;
+        _replayData.open(std::filesystem::path(dir) / "traffic.dat", std::ios::binary);
+        std::ifstream index(std::filesystem::path(dir) / "traffic.idx", std::ios::binary);
+        if (!_replayData || !index)
+            throw std::runtime_error("Cannot open traffic archive for reading in '" + dir + "'");
 
-        // Queue up all the items,
-        for (const auto &id : getJson(_domain, _id_url))
+        while (index.peek() != std::char_traits<char>::eof())
         {
-            std::string postId = std::to_string(id.get<long long>());
-            std::string postUrl = std::regex_replace(_story_url, std::regex("%ID%"), postId);
-            futures.push_back(std::async(std::launch::async, getJson, _domain, postUrl));
-            if (counter > maxPosts)
+            std::string key = readString(index);
+            auto offset = readValue<uint64_t>(index);
+            if (!index)
                 break;
-            ++counter;
+            _offsets[key].push_back(offset);
         }
+        _replaying = true;
+    }
 
-        // Wait until all futures are finished
-        int finishedFutures = 0;
-        while (finishedFutures < maxPosts)
+    [[nodiscard]] bool recording() const { return _recording; }
+    [[nodiscard]] bool replaying() const { return _replaying; }
+
+    void record(const std::string &domain, const std::string &url, const httpResponse &res)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        uint64_t offset = _data.tellp();
+        writeString(_data, domain + url);
+        writeValue<int32_t>(_data, res.status);
+        writeValue<int64_t>(_data, res.elapsed.count());
+        writeString(_data, res.reason);
+        writeValue<uint32_t>(_data, res.headers.size());
+        for (const auto &[key, value] : res.headers)
         {
-            for (const auto &future : futures)
-            {
-                if (isReady(future))
-                    ++finishedFutures;
-            }
+            writeString(_data, key);
+            writeString(_data, value);
         }
+        writeValue<uint64_t>(_data, res.body.size());
+        _data.write(res.body.data(), res.body.size());
+        _data.flush();
+
+        writeString(_index, domain + url);
+        writeValue<uint64_t>(_index, offset);
+        _index.flush();
+    }
 
-        for (auto &future : futures)
+    httpResponse replay(const std::string &domain, const std::string &url)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto offsets = _offsets.find(domain + url);
+        if (offsets == _offsets.end())
+            throw std::runtime_error("No recorded response for domain='" + domain + "', url='" + url + "'");
+
+        // repeated requests get the next recording, the last one keeps repeating
+        size_t &served = _served[domain + url];
+        auto offset = offsets->second.at(std::min(served, offsets->second.size() - 1));
+        ++served;
+
+        _replayData.clear();
+        _replayData.seekg(offset);
+        readString(_replayData); // key
+        httpResponse res;
+        res.status = readValue<int32_t>(_replayData);
+        res.elapsed = std::chrono::microseconds(readValue<int64_t>(_replayData));
+        res.reason = readString(_replayData);
+        auto headerCount = readValue<uint32_t>(_replayData);
+        for (uint32_t i = 0; i < headerCount; ++i)
         {
-            posts.push_back(future.get());
+            std::string key = readString(_replayData);
+            res.headers.emplace(std::move(key), readString(_replayData));
         }
-
-        return posts;
+        res.body.resize(readValue<uint64_t>(_replayData));
+        _replayData.read(res.body.data(), res.body.size());
+        if (!_replayData)
+            throw std::runtime_error("Truncated recorded response for domain='" + domain + "', url='" + url + "'");
+        return res;
     }
 
 private:
-    std::string _id_url;
-    std::string _story_url;
-    std::string _domain;
+    bool _recording {false};
+    bool _replaying {false};
+    std::mutex _mutex;
+    std::ofstream _data;
+    std::ofstream _index;
+    std::ifstream _replayData;
+    std::unordered_map<std::string, std::vector<uint64_t>> _offsets;
+    std::unordered_map<std::string, size_t> _served;
 };
 
-void printTm(const tm *tp);
-void printCurrentDate()
+trafficArchive &Traffic()
 {
-    time_t t_now = time(nullptr);
-    tm *tm_now = localtime(&t_now);
-    char now[200] {""};
-    strftime(now, sizeof(now), "%Y-%m-%dT%H:%M:%S %z", tm_now);
-    std::cout << "Current date/time: " << now << "\n\n";
+    static trafficArchive archive;
+    return archive;
 }
 
-void printTm(const tm *tp)
+//64 bit FNV-1a, a hash that stays the same across builds and platforms
+constexpr uint64_t stableHash(std::string_view text)
 {
-    if (tp->tm_yday > 0)
-        std::cout << tp->tm_yday << " days, ";
-    if (tp->tm_hour > 0)
-        std::cout << tp->tm_hour << " hours, ";
-    if (tp->tm_min > 0)
-        std::cout << tp->tm_min << " minutes, ";
-    if (tp->tm_sec > 0)
-        std::cout << tp->tm_sec << " seconds ";
+    uint64_t hash = 0xcbf29ce484222325;
+    for (char c : text)
+    {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3;
+    }
+    return hash;
 }
 
-template <typename T>
-T calcAverage(const std::vector<T> &vec)
+//the posts of one source in a run, as stored in the history
+struct postSection
 {
-    auto sum = std::accumulate(vec.cbegin(), vec.cend(), 0);
-    return sum / vec.size();
-}
+    std::string source;
+    const PostTable &posts;
+};
 
-void analyze(std::vector<Post> &lobstersPosts, std::vector<Post> &hnPosts)
+//A column file holds the posts of one run so they can be mapped and read in
+//place. After a fixed header come the fixed width columns (source index,
+//submit time, votes, comments, url hash), then per string column (id, title,
+//url, submitter, comment url) rows+1 offsets into the string heap, and the
+//heap itself with the strings of each column stored together. The source
+//names are the first strings in the heap. Every column starts 8 byte aligned.
+struct columnHeader
 {
-    std::cout << "Number of posts from Lobsters    : " << lobstersPosts.size() << "\n";
-    std::cout << "Number of posts from Hacker News : " << hnPosts.size() << "\n\n";
+    static constexpr std::array<char, 4> expectedMagic {'H', 'L', 'P', 'C'};
+    static constexpr uint32_t currentVersion = 1;
 
-    // set_intersection requires vectors to be sorted
-    std::sort(hnPosts.begin(), hnPosts.end());
-    std::sort(lobstersPosts.begin(), lobstersPosts.end());
+    std::array<char, 4> magic {expectedMagic};
+    uint32_t version {currentVersion};
+    int64_t runTime {0};
+    uint64_t rows {0};
+    uint32_t sources {0};
+    uint32_t reserved {0};
+    uint64_t heapSize {0};
+};
+static_assert(sizeof(columnHeader) == 40);
+
+//byte offsets of the columns in a column file, the same for writer and reader
+struct columnLayout
+{
+    static constexpr size_t stringColumns = 5;
 
-    std::vector<Post> post_intersection;
-    std::set_intersection(hnPosts.begin(), hnPosts.end(), lobstersPosts.begin(), lobstersPosts.end(), std::back_inserter(post_intersection));
+    columnLayout(uint64_t rows, uint64_t sources, uint64_t heapSize)
+    {
+        uint64_t end = sizeof(columnHeader);
+        auto column = [&end](uint64_t bytes) {
+            uint64_t start = end;
+            end = (start + bytes + 7) & ~uint64_t(7);
+            return start;
+        };
+        sourceNames = column((sources + 1) * sizeof(uint32_t));
+        source = column(rows * sizeof(uint32_t));
+        submitTimestamp = column(rows * sizeof(int64_t));
+        votes = column(rows * sizeof(int32_t));
+        commentCount = column(rows * sizeof(int32_t));
+        urlHash = column(rows * sizeof(uint64_t));
+        for (auto &offsets : strings)
+            offsets = column((rows + 1) * sizeof(uint32_t));
+        heap = column(heapSize);
+        size = end;
+    }
 
-    std::cout << "Matches (" << post_intersection.size() << "):\n\n";
+    uint64_t sourceNames, source, submitTimestamp, votes, commentCount, urlHash;
+    std::array<uint64_t, stringColumns> strings {};
+    uint64_t heap, size;
+};
 
-    std::vector<Post> firstOnLobsters;
-    std::vector<Post> lastOnLobsters;
-    std::vector<Post> firstOnHN;
-    std::vector<Post> lastOnHN;
-    std::vector<time_t> timeDiff;
-    std::vector<int> lobstersScore;
-    std::vector<int> lobstersComments;
+//the column file of a run, built in memory
+std::string encodeColumns(time_t runTime, const std::vector<postSection> &sections)
+{
+    columnHeader header;
+    header.runTime = runTime;
+    header.sources = sections.size();
+    for (const auto &section : sections)
+        header.rows += section.posts.size();
 
-    std::vector<int> hnScore;
-    std::vector<int> hnComments;
+    std::string heap;
+    std::vector<uint32_t> sourceNames {0};
+    for (const auto &section : sections)
+    {
+        heap += section.source;
+        sourceNames.push_back(heap.size());
+    }
+    std::array<std::vector<uint32_t>, columnLayout::stringColumns> offsets;
+    std::array<std::string_view (PostTable::*)(size_t) const, columnLayout::stringColumns> strings {
+        &PostTable::id, &PostTable::title, &PostTable::original_url, &PostTable::submitter, &PostTable::comment_url};
+    for (size_t column = 0; column < strings.size(); ++column)
+    {
+        offsets[column].reserve(header.rows + 1);
+        offsets[column].push_back(heap.size());
+        for (const auto &section : sections)
+        {
+            for (size_t row = 0; row < section.posts.size(); ++row)
+            {
+                heap += (section.posts.*strings[column])(row);
+                offsets[column].push_back(heap.size());
+            }
+        }
+    }
+    if (heap.size() > std::numeric_limits<uint32_t>::max())
+        throw std::runtime_error("Too many posts for one column file");
+    header.heapSize = heap.size();
 
-    for (const auto &p : post_intersection)
+    columnLayout layout(header.rows, header.sources, header.heapSize);
+    std::string file(layout.size, '\0');
+    auto put = [&file](uint64_t offset, const void *data, size_t size) { std::memcpy(file.data() + offset, data, size); };
+    put(0, &header, sizeof(header));
+    put(layout.sourceNames, sourceNames.data(), sourceNames.size() * sizeof(uint32_t));
+    uint64_t row = 0;
+    for (uint32_t source = 0; source < sections.size(); ++source)
     {
-        auto hnPost = std::find_if(hnPosts.begin(), hnPosts.end(), [&cp = p](const Post &p) -> bool { return cp == p; });
-        if (hnPost == hnPosts.end())
-            continue;
+        const auto &posts = sections[source].posts;
+        for (size_t i = 0; i < posts.size(); ++i, ++row)
+        {
+            int64_t submitTimestamp = posts.submit_timestamp(i);
+            int32_t votes = posts.votes(i);
+            int32_t commentCount = posts.comment_count(i);
+            uint64_t urlHash = stableHash(posts.original_url(i));
+            put(layout.source + row * sizeof(uint32_t), &source, sizeof(source));
+            put(layout.submitTimestamp + row * sizeof(int64_t), &submitTimestamp, sizeof(submitTimestamp));
+            put(layout.votes + row * sizeof(int32_t), &votes, sizeof(votes));
+            put(layout.commentCount + row * sizeof(int32_t), &commentCount, sizeof(commentCount));
+            put(layout.urlHash + row * sizeof(uint64_t), &urlHash, sizeof(urlHash));
+        }
+    }
+    for (size_t column = 0; column < offsets.size(); ++column)
+        put(layout.strings[column], offsets[column].data(), offsets[column].size() * sizeof(uint32_t));
+    put(layout.heap, heap.data(), heap.size());
+    return file;
+}
 
-        auto lobstersPost = std::find_if(lobstersPosts.begin(), lobstersPosts.end(), [&cp = p](const Post &p) -> bool { return cp == p; });
-        if (lobstersPost == lobstersPosts.end())
-            continue;
+//Read only view of a column file, mapped into memory. Opening it checks the
+//header, the string offsets and the source of every row, the other columns
+//are read in place when they are used, so mapping a year of runs costs a few
+//system calls and one pass over the offsets per file. Has the same
+//accessors as PostTable, plus the source and url hash of every row.
+class mappedPostTable
+{
+public:
+    explicit mappedPostTable(const std::filesystem::path &file)
+    {
+        int fd = ::open(file.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open column file '" + file.string() + "'");
+        struct stat info {};
+        if (::fstat(fd, &info) != 0 || static_cast<uint64_t>(info.st_size) < sizeof(columnHeader))
+        {
+            ::close(fd);
+            throw std::runtime_error("Truncated column file '" + file.string() + "'");
+        }
+        _size = info.st_size;
+        void *mapped = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+            throw std::runtime_error("Cannot map column file '" + file.string() + "'");
+        _data = static_cast<const char *>(mapped);
 
-        Post firstPost = *lobstersPost;
-        Post secondPost = *hnPost;
-        std::string firstName = "Lobsters";
-        std::string secondName = "HackerNews";
-        if (hnPost->submit_timestamp < lobstersPost->submit_timestamp)
+        std::memcpy(&_header, _data, sizeof(_header));
+        if (_header.magic != columnHeader::expectedMagic || _header.version != columnHeader::currentVersion)
         {
-            firstOnHN.push_back(p);
-            lastOnLobsters.push_back(p);
-            std::swap(firstName, secondName);
-            std::swap(firstPost, secondPost);
+            unmap();
+            throw std::runtime_error("Not a column file or unsupported version: '" + file.string() + "'");
         }
-        else
+        // every count must fit the file before the layout is computed from them, so it cannot overflow
+        constexpr uint64_t bytesPerRow = sizeof(uint32_t) + sizeof(int64_t) + 2 * sizeof(int32_t) + sizeof(uint64_t) + columnLayout::stringColumns * sizeof(uint32_t);
+        if (_header.rows > _size / bytesPerRow || _header.sources >= _size / sizeof(uint32_t) || _header.heapSize > _size
+            || columnLayout(_header.rows, _header.sources, _header.heapSize).size > _size)
         {
-            firstOnLobsters.push_back(p);
-            lastOnHN.push_back(p);
+            unmap();
+            throw std::runtime_error("Corrupt column file '" + file.string() + "'");
         }
+        columnLayout layout(_header.rows, _header.sources, _header.heapSize);
+        _sourceNames = column<uint32_t>(layout.sourceNames);
+        _source = column<uint32_t>(layout.source);
+        _submitTimestamp = column<int64_t>(layout.submitTimestamp);
+        _votes = column<int32_t>(layout.votes);
+        _commentCount = column<int32_t>(layout.commentCount);
+        _urlHash = column<uint64_t>(layout.urlHash);
+        for (size_t i = 0; i < _strings.size(); ++i)
+            _strings[i] = column<uint32_t>(layout.strings[i]);
+        _heap = _data + layout.heap;
 
-        lobstersComments.push_back(lobstersPost->comment_count);
-        lobstersScore.push_back(lobstersPost->votes);
-        hnComments.push_back(hnPost->comment_count);
-        hnScore.push_back(hnPost->votes);
-
-        std::cout << "# " << p.title << "  \nURL: " << p.original_url << "  \n";
+        // the offsets of the string columns follow each other through the heap
+        // and end at its end, and every row belongs to one of the sources
+        uint32_t previous = 0;
+        auto ascending = [&previous](const uint32_t *offsets, uint64_t count) {
+            for (uint64_t i = 0; i < count; ++i)
+            {
+                if (offsets[i] < previous)
+                    return false;
+                previous = offsets[i];
+            }
+            return true;
+        };
+        bool valid = ascending(_sourceNames, _header.sources + 1);
+        for (const uint32_t *offsets : _strings)
+            valid = valid && ascending(offsets, _header.rows + 1);
+        valid = valid && previous == _header.heapSize;
+        for (uint64_t row = 0; valid && row < _header.rows; ++row)
+            valid = _source[row] < _header.sources;
+        if (!valid)
+        {
+            unmap();
+            throw std::runtime_error("Corrupt column file '" + file.string() + "'");
+        }
+    }
 
-        std::cout << "First appeared on **" << firstName << "** with " << firstPost.votes
-                  << " votes and " << firstPost.comment_count << " comments, submitted by "
-                  << firstPost.submitter << " (" << firstPost.printDateTimeLocal() << "; "
-                  << firstPost.comment_url << " ).  \n";
+    mappedPostTable(const mappedPostTable &) = delete;
+    mappedPostTable &operator=(const mappedPostTable &) = delete;
+    mappedPostTable(mappedPostTable &&other) noexcept { *this = std::move(other); }
+    mappedPostTable &operator=(mappedPostTable &&other) noexcept
+    {
+        if (this != &other)
+        {
+            unmap();
+            _data = std::exchange(other._data, nullptr);
+            _size = std::exchange(other._size, 0);
+            _header = other._header;
+            _sourceNames = other._sourceNames;
+            _source = other._source;
+            _submitTimestamp = other._submitTimestamp;
+            _votes = other._votes;
+            _commentCount = other._commentCount;
+            _urlHash = other._urlHash;
+            _strings = other._strings;
+            _heap = other._heap;
+        }
+        return *this;
+    }
+    ~mappedPostTable() { unmap(); }
 
-        time_t diffSec = difftime(secondPost.submit_timestamp, firstPost.submit_timestamp);
+    [[nodiscard]] time_t runTime() const { return _header.runTime; }
+    [[nodiscard]] size_t sources() const { return _header.sources; }
+    [[nodiscard]] std::string_view sourceName(size_t source) const { return {_heap + _sourceNames[source], _sourceNames[source + 1] - _sourceNames[source]}; }
+    [[nodiscard]] size_t size() const { return _header.rows; }
+    [[nodiscard]] size_t source(size_t row) const { return _source[row]; }
+    [[nodiscard]] std::string_view id(size_t row) const { return string(0, row); }
+    [[nodiscard]] time_t submit_timestamp(size_t row) const { return _submitTimestamp[row]; }
+    [[nodiscard]] std::string_view title(size_t row) const { return string(1, row); }
+    [[nodiscard]] std::string_view original_url(size_t row) const { return string(2, row); }
+    [[nodiscard]] std::string_view submitter(size_t row) const { return string(3, row); }
+    [[nodiscard]] std::string_view comment_url(size_t row) const { return string(4, row); }
+    [[nodiscard]] int votes(size_t row) const { return _votes[row]; }
+    [[nodiscard]] int comment_count(size_t row) const { return _commentCount[row]; }
+    [[nodiscard]] uint64_t urlHash(size_t row) const { return _urlHash[row]; }
 
-        timeDiff.push_back(diffSec);
+private:
+    template <typename T>
+    const T *column(uint64_t offset) const
+    {
+        return reinterpret_cast<const T *>(_data + offset);
+    }
 
-        if (std::chrono::seconds(diffSec) < std::chrono::hours(1))
-            std::cout << "**Within the hour this was also posted to " << secondName << "!**\n";
+    [[nodiscard]] std::string_view string(size_t column, size_t row) const
+    {
+        const uint32_t *offsets = _strings[column];
+        return {_heap + offsets[row], offsets[row + 1] - offsets[row]};
+    }
 
-        tm *tp = gmtime(&diffSec); // utc
-        std::cout << "After ";
-        printTm(tp);
+    void unmap()
+    {
+        if (_data)
+            ::munmap(const_cast<char *>(_data), _size);
+        _data = nullptr;
+    }
 
-        std::cout << "it was submitted to **" << secondName << "** by " << secondPost.submitter << " with "
-                  << secondPost.votes << " votes and " << secondPost.comment_count << " comments ("
-                  << secondPost.printDateTimeLocal() << "; " << secondPost.comment_url << " ).  \n";
+    const char *_data {nullptr};
+    size_t _size {0};
+    columnHeader _header;
+    const uint32_t *_sourceNames {nullptr};
+    const uint32_t *_source {nullptr};
+    const int64_t *_submitTimestamp {nullptr};
+    const int32_t *_votes {nullptr};
+    const int32_t *_commentCount {nullptr};
+    const uint64_t *_urlHash {nullptr};
+    std::array<const uint32_t *, columnLayout::stringColumns> _strings {};
+    const char *_heap {nullptr};
+};
 
-        std::string highestScore = (firstPost.votes > secondPost.votes) ? firstName : secondName;
-        if ((firstPost.votes + secondPost.votes) <= 0)
-            highestScore = "nowhere";
+//Append-only history of the posts seen by every run, in dir/snapshots.dat
+//with one index entry per run in dir/snapshots.idx (run time, offset and
+//size of the snapshot, framed by a magic number and a checksum). A torn
+//entry at the end of the index is cut off when the history is opened, and
+//entries that fail their checksum or point past the data are skipped. A snapshot is the run time, a label (the command)
+//and sections of posts per source. A post is stored as its id, submit
+//time, votes, comments and a hash of its url. The snapshot is encoded on
+//the calling thread and written on a background thread, the run doesn't
+//wait for the disk. Every run also gets a column file with the full posts
+//in dir/columns, for analysis that maps the history instead of parsing it.
+class snapshotStore
+{
+public:
+    struct indexEntry
+    {
+        int64_t runTime;
+        uint64_t offset;
+        uint64_t size;
+    };
 
-        std::string mostComments = (firstPost.comment_count > secondPost.comment_count) ? firstName : secondName;
-        if ((firstPost.comment_count + secondPost.comment_count) <= 0)
-            mostComments = "nowhere";
+    //bytes of an entry in snapshots.idx: magic, checksum, run time, offset and size
+    static constexpr size_t indexEntrySize = 32;
 
-        std::cout << "The highest score was reached on " << highestScore
-                  << " and the most comments were on " << mostComments << ".  \n";
+    ~snapshotStore()
+    {
+        if (_writing.valid())
+            _writing.wait();
+    }
 
-        if (firstPost.submitter == secondPost.submitter)
-            std::cout << "**The same username submitted the post to both sites**.  \n";
+    void start(const std::string &dir)
+    {
+        std::filesystem::create_directories(dir);
+        _data = std::filesystem::path(dir) / "snapshots.dat";
+        _index = std::filesystem::path(dir) / "snapshots.idx";
+        _columns = std::filesystem::path(dir) / "columns";
+        _enabled = true;
 
-        std::cout << "\n";
+        // a crash while appending can leave part of an entry, which would shift all later ones
+        std::error_code error;
+        auto indexSize = std::filesystem::file_size(_index, error);
+        if (!error && indexSize % indexEntrySize != 0)
+        {
+            std::cout << "Cutting off a partial entry at the end of '" << _index.string() << "'\n";
+            std::filesystem::resize_file(_index, indexSize - indexSize % indexEntrySize);
+        }
     }
 
-    std::cout << firstOnLobsters.size() << " posts appeared first on Lobsters and " << firstOnHN.size() << " posts appeared first on HackerNews.\n";
+    [[nodiscard]] bool enabled() const { return _enabled; }
 
-    time_t sum = std::accumulate(timeDiff.cbegin(), timeDiff.cend(), 0ll);
-    time_t avg = sum / timeDiff.size();
+    void append(time_t runTime, const std::string &label, const std::vector<postSection> &sections)
+    {
+        if (!_enabled)
+            return;
 
-    tm *diff_tp = gmtime(&avg);
-    std::cout << "Average time for a cross-post: ";
-    printTm(diff_tp);
-    std::cout << ".\n";
+        std::ostringstream encoded;
+        writeValue<int64_t>(encoded, runTime);
+        writeString(encoded, label);
+        writeValue<uint32_t>(encoded, sections.size());
+        for (const auto &section : sections)
+        {
+            writeString(encoded, section.source);
+            writeValue<uint32_t>(encoded, section.posts.size());
+            for (size_t row = 0; row < section.posts.size(); ++row)
+            {
+                writeString(encoded, std::string(section.posts.id(row)));
+                writeValue<int64_t>(encoded, section.posts.submit_timestamp(row));
+                writeValue<int32_t>(encoded, section.posts.votes(row));
+                writeValue<int32_t>(encoded, section.posts.comment_count(row));
+                writeValue<uint64_t>(encoded, stableHash(section.posts.original_url(row)));
+            }
+        }
 
-    std::cout << "Average comments on HN: " << calcAverage(hnComments) << ", Lobsters: " << calcAverage(lobstersComments) << ".\n";
-    std::cout << "Average score on HN: " << calcAverage(hnScore) << ", Lobsters: " << calcAverage(lobstersScore) << ".\n";
-}
+        std::string columns = encodeColumns(runTime, sections);
 
-std::vector<std::string> &Arguments()
-{
-    static std::vector<std::string> arguments;
-    return arguments;
-}
+        // one snapshot per run, but never two writers on the files
+        if (_writing.valid())
+            _writing.wait();
+        _writing = std::async(std::launch::async, [this, runTime, snapshot = std::move(encoded).str(), columns = std::move(columns)] {
+            // nobody waits for the result, so a failure is reported here and the other file is still written
+            auto reportFailure = [](const std::function<void()> &write) {
+                try
+                {
+                    write();
+                }
+                catch (const std::exception &e)
+                {
+                    std::cout << "Cannot write the history: " << e.what() << "\n";
+                }
+            };
+            reportFailure([&] { writeColumns(runTime, columns); });
+            reportFailure([&] { writeSnapshot(runTime, snapshot); });
+        });
+    }
 
-void usage()
-{
-    std::cout << "Usage: " << Arguments().at(0) << " [help|test|top|new]\n";
-    std::cout << Arguments().at(0) << " top: analyze top stories from HN & Lobsters.\n";
-    std::cout << Arguments().at(0) << " help: this text.\n";
-    std::cout << Arguments().at(0) << " test: run a test to check your timezones.\n";
-    std::cout << Arguments().at(0) << " new: get new posts instead of best.\n";
-}
+    //the runs in the history, oldest first
+    [[nodiscard]] std::vector<indexEntry> index() const
+    {
+        std::vector<indexEntry> entries;
+        std::error_code error;
+        auto dataSize = std::filesystem::file_size(_data, error);
+        if (error)
+            return entries;
+        std::ifstream index(_index, std::ios::binary);
+        for (size_t skipped = 0; index.peek() != std::char_traits<char>::eof();)
+        {
+            auto magic = readValue<uint32_t>(index);
+            auto checksum = readValue<uint32_t>(index);
+            indexEntry entry {};
+            entry.runTime = readValue<int64_t>(index);
+            entry.offset = readValue<uint64_t>(index);
+            entry.size = readValue<uint64_t>(index);
+            if (!index)
+                break;
+            if (magic != indexMagic || checksum != entryChecksum(entry) || entry.offset + entry.size > dataSize)
+            {
+                if (skipped++ == 0)
+                    std::cout << "Skipping damaged entries in '" << _index.string() << "'\n";
+                continue;
+            }
+            entries.push_back(entry);
+        }
+        return entries;
+    }
 
-int main(int argc, char *argv[])
-{
-    for (int i = 0; i < argc; ++i)
+private:
+    //renamed into place only when it was written completely, so a mapped column file is never partial
+    void writeColumns(time_t runTime, const std::string &columns) const
     {
-        Arguments().push_back(argv[i]);
+        std::filesystem::create_directories(_columns);
+        auto columnFile = _columns / (std::to_string(runTime) + ".cols");
+        for (int run = 1; std::filesystem::exists(columnFile); ++run)
+            columnFile = _columns / (std::to_string(runTime) + "-" + std::to_string(run) + ".cols");
+        auto partial = columnFile;
+        partial += ".partial";
+        std::ofstream out(partial, std::ios::binary | std::ios::trunc);
+        out.write(columns.data(), columns.size());
+        out.close();
+        if (!out)
+        {
+            std::error_code ignored;
+            std::filesystem::remove(partial, ignored);
+            throw std::runtime_error("Cannot write column file '" + columnFile.string() + "'");
+        }
+        std::filesystem::rename(partial, columnFile);
     }
 
-#ifndef __GNUG__
-    std::cout << "Please use GCC to compile, we're using it's struct tm tm_gmtoff extension.";
-    return 1;
+    static constexpr uint32_t indexMagic = 0x49534c48; // "HLSI"
+
+    static uint32_t entryChecksum(const indexEntry &entry)
+    {
+        std::string bytes;
+        bytes.append(reinterpret_cast<const char *>(&entry.runTime), sizeof(entry.runTime));
+        bytes.append(reinterpret_cast<const char *>(&entry.offset), sizeof(entry.offset));
+        bytes.append(reinterpret_cast<const char *>(&entry.size), sizeof(entry.size));
+        return static_cast<uint32_t>(stableHash(bytes));
+    }
+
+    void writeSnapshot(time_t runTime, const std::string &snapshot) const
+    {
+        std::ofstream data(_data, std::ios::binary | std::ios::app);
+        data.seekp(0, std::ios::end);
+        indexEntry entry {runTime, static_cast<uint64_t>(data.tellp()), snapshot.size()};
+        data.write(snapshot.data(), snapshot.size());
+        data.flush();
+        // only indexed once the data is complete, a crash leaves at most unindexed bytes
+        if (!data)
+            throw std::runtime_error("Cannot append to '" + _data.string() + "'");
+
+        std::ostringstream encoded;
+        writeValue<uint32_t>(encoded, indexMagic);
+        writeValue<uint32_t>(encoded, entryChecksum(entry));
+        writeValue<int64_t>(encoded, entry.runTime);
+        writeValue<uint64_t>(encoded, entry.offset);
+        writeValue<uint64_t>(encoded, entry.size);
+        std::ofstream index(_index, std::ios::binary | std::ios::app);
+        index << encoded.str();
+        index.flush();
+        if (!index)
+            throw std::runtime_error("Cannot append to '" + _index.string() + "'");
+    }
+
+public:
+    //The column files of the runs in the history mapped into memory, oldest
+    //first. A file that is not named after a run time or cannot be mapped is
+    //reported and skipped.
+    [[nodiscard]] std::vector<mappedPostTable> columns() const
+    {
+        std::vector<std::pair<time_t, std::filesystem::path>> files;
+        std::error_code error;
+        for (std::filesystem::directory_iterator entry(_columns, error), end; !error && entry != end; entry.increment(error))
+        {
+            if (entry->path().extension() != ".cols")
+                continue;
+            // "<run time>.cols" or "<run time>-<n>.cols"
+            std::string stem = entry->path().stem().string();
+            time_t runTime = 0;
+            auto [rest, parsed] = std::from_chars(stem.data(), stem.data() + stem.size(), runTime);
+            if (parsed != std::errc() || (rest != stem.data() + stem.size() && *rest != '-'))
+            {
+                std::cout << "Skipping '" << entry->path().string() << "', not named after a run time.\n";
+                continue;
+            }
+            files.emplace_back(runTime, entry->path());
+        }
+        std::sort(files.begin(), files.end());
+        std::vector<mappedPostTable> tables;
+        tables.reserve(files.size());
+        for (const auto &[runTime, file] : files)
+        {
+            try
+            {
+                tables.emplace_back(file);
+            }
+            catch (const std::exception &e)
+            {
+                std::cout << "Skipping a column file: " << e.what() << "\n";
+            }
+        }
+        return tables;
+    }
+
+private:
+    bool _enabled {false};
+    std::filesystem::path _data;
+    std::filesystem::path _index;
+    std::filesystem::path _columns;
+    std::future<void> _writing;
+};
+
+snapshotStore &History()
+{
+    static snapshotStore history;
+    return history;
+}
+
+//Prometheus metrics. Every thread counts into its own shard of atomic
+//slots, which only that thread writes, so counting takes no lock and no
+//read-modify-write. A scrape sums the shards. A series is registered once
+//per name and labels under the mutex, callers keep the returned slot so
+//counting is only add(). The shard of a thread that ends is added to the
+//retired totals and reused by the next new thread. Every thread with a
+//shard shares the ownership of the registry, so a thread that ends after
+//the statics are gone still has it to give its shard back to.
+class metricsRegistry : public std::enable_shared_from_this<metricsRegistry>
+{
+public:
+    //upper bounds in seconds, the last bucket is +Inf
+    static constexpr std::array<double, 11> bucketBounds {0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+
+    //adds time from construction to destruction to a histogram, also across co_await
+    class scopedTimer
+    {
+    public:
+        scopedTimer(metricsRegistry &registry, size_t histogram) :
+            _registry(registry), _histogram(histogram), _start(std::chrono::steady_clock::now()) {};
+        scopedTimer(const scopedTimer &) = delete;
+        scopedTimer &operator=(const scopedTimer &) = delete;
+        ~scopedTimer() { _registry.observe(_histogram, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _start)); }
+
+    private:
+        metricsRegistry &_registry;
+        size_t _histogram;
+        std::chrono::steady_clock::time_point _start;
+    };
+
+    //labels as in the exposition format, e.g. domain="lobste.rs". Registers
+    //the series (or finds it) under the lock, keep the slot.
+    size_t counter(std::string_view name, std::string_view help, std::string_view labels = {})
+    {
+        return series(name, help, "counter", labels, 1);
+    }
+
+    size_t histogram(std::string_view name, std::string_view help, std::string_view labels = {})
+    {
+        return series(name, help, "histogram", labels, histogramSlots);
+    }
+
+    void add(size_t slot, uint64_t value = 1)
+    {
+        auto &counted = local().slots[slot];
+        counted.store(counted.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    void observe(size_t histogram, std::chrono::microseconds elapsed)
+    {
+        double seconds = std::chrono::duration<double>(elapsed).count();
+        size_t bucket = std::lower_bound(bucketBounds.begin(), bucketBounds.end(), seconds) - bucketBounds.begin();
+        add(histogram + bucket);
+        add(histogram + bucketBounds.size() + 1, std::max<int64_t>(elapsed.count(), 0));
+    }
+
+    scopedTimer timer(size_t histogram) { return {*this, histogram}; }
+
+    //the text exposition format
+    std::string scrape()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto total = [this](size_t slot) {
+            uint64_t sum = _retired[slot];
+            for (const auto &shard : _shards)
+                sum += shard->slots[slot].load(std::memory_order_relaxed);
+            return sum;
+        };
+
+        std::ostringstream text;
+        for (const auto &family : _families)
+        {
+            text << "# HELP " << family.name << " " << family.help << "\n";
+            text << "# TYPE " << family.name << " " << family.type << "\n";
+            for (const auto &[labels, slot] : family.series)
+            {
+                auto withLabels = [&labels = labels](const std::string &extra) {
+                    std::string all = labels.empty() || extra.empty() ? labels + extra : labels + "," + extra;
+                    return all.empty() ? all : "{" + all + "}";
+                };
+                if (family.type == "counter")
+                {
+                    text << family.name << withLabels("") << " " << total(slot) << "\n";
+                    continue;
+                }
+                uint64_t cumulative = 0;
+                for (size_t bucket = 0; bucket <= bucketBounds.size(); ++bucket)
+                {
+                    cumulative += total(slot + bucket);
+                    std::ostringstream bound;
+                    if (bucket < bucketBounds.size())
+                        bound << bucketBounds[bucket];
+                    else
+                        bound << "+Inf";
+                    text << family.name << "_bucket" << withLabels("le=\"" + bound.str() + "\"") << " " << cumulative << "\n";
+                }
+                text << family.name << "_sum" << withLabels("") << " " << total(slot + bucketBounds.size() + 1) / 1e6 << "\n";
+                text << family.name << "_count" << withLabels("") << " " << cumulative << "\n";
+            }
+        }
+        return text.str();
+    }
+
+    //--metrics=file, for the textfile collector of node_exporter
+    void exportTo(const std::string &file) { _file = file; }
+
+    //replaces the file at once, the collector never reads a partial file.
+    //Also called from a destructor, so a failure is reported, never thrown.
+    void writeTextfile() noexcept
+    {
+        if (_file.empty())
+            return;
+        try
+        {
+            auto partial = _file;
+            partial += ".partial";
+            std::ofstream out(partial, std::ios::trunc);
+            out << scrape();
+            out.close();
+            std::error_code error;
+            if (!out)
+                error = std::make_error_code(std::errc::io_error);
+            else
+                std::filesystem::rename(partial, _file, error);
+            if (error)
+            {
+                std::filesystem::remove(partial, error);
+                std::cout << "Warning: cannot write the metrics to '" << _file << "'\n";
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::cout << "Warning: cannot write the metrics to '" << _file << "': " << e.what() << "\n";
+        }
+    }
+
+private:
+    static constexpr size_t maxSlots = 1024;
+    static constexpr size_t histogramSlots = bucketBounds.size() + 2; // buckets, +Inf and the sum in microseconds
+
+    struct shard
+    {
+        std::array<std::atomic<uint64_t>, maxSlots> slots {};
+    };
+
+    struct family
+    {
+        std::string name;
+        std::string help;
+        std::string type;
+        std::vector<std::pair<std::string, size_t>> series; // labels and first slot
+    };
+
+    //the shard of the calling thread, given back when the thread ends
+    shard &local()
+    {
+        struct lease
+        {
+            std::shared_ptr<metricsRegistry> registry;
+            shard *leased;
+            ~lease() { registry->retire(leased); }
+        };
+        thread_local lease current {shared_from_this(), acquire()};
+        return *current.leased;
+    }
+
+    shard *acquire()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_free.empty())
+        {
+            auto *reused = _free.back();
+            _free.pop_back();
+            return reused;
+        }
+        return _shards.emplace_back(std::make_unique<shard>()).get();
+    }
+
+    void retire(shard *retired)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (size_t slot = 0; slot < _nextSlot; ++slot)
+            _retired[slot] += retired->slots[slot].exchange(0, std::memory_order_relaxed);
+        _free.push_back(retired);
+    }
+
+    size_t series(std::string_view name, std::string_view help, std::string_view type, std::string_view labels, size_t slots)
+    {
+        std::string key(name);
+        key += '{';
+        key += labels;
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto registered = _slots.find(key);
+        if (registered == _slots.end())
+        {
+            // past the capacity everything is counted in the last slot, which is never exported
+            size_t slot = _nextSlot + slots <= maxSlots - histogramSlots ? _nextSlot : maxSlots - histogramSlots;
+            if (slot == _nextSlot)
+            {
+                _nextSlot += slots;
+                auto existing = std::find_if(_families.begin(), _families.end(), [name](const family &f) { return f.name == name; });
+                if (existing == _families.end())
+                    existing = _families.insert(existing, family {std::string(name), std::string(help), std::string(type), {}});
+                existing->series.emplace_back(std::string(labels), slot);
+            }
+            registered = _slots.emplace(key, slot).first;
+        }
+        return registered->second;
+    }
+
+    std::mutex _mutex;
+    std::vector<family> _families;
+    std::unordered_map<std::string, size_t> _slots;
+    size_t _nextSlot {0};
+    std::vector<std::unique_ptr<shard>> _shards;
+    std::vector<shard *> _free;
+    std::array<uint64_t, maxSlots> _retired {};
+    std::string _file;
+};
+
+metricsRegistry &Metrics()
+{
+    static auto metrics = std::make_shared<metricsRegistry>();
+    return *metrics;
+}
+
+//the miss and hit slots of a cache
+std::array<size_t, 2> cacheLookupSlots(const std::string &cache)
+{
+    const char *help = "Lookups in the resolver, TLS session and connection caches.";
+    return {Metrics().counter("hn_lob_comp_cache_lookups_total", help, "cache=\"" + cache + "\",result=\"miss\""),
+            Metrics().counter("hn_lob_comp_cache_lookups_total", help, "cache=\"" + cache + "\",result=\"hit\"")};
+}
+
+class tlsContext;
+tlsContext &Tls();
+
+//Process wide TLS state for the upstream connections. The CA bundle is
+//loaded once into a shared X509_STORE that every client context references,
+//OpenSSL verifies the chain and host name during the handshake, and the
+//sessions are cached per host so the next connection to the same host
+//resumes with an abbreviated handshake.
+class tlsContext
+{
+public:
+    explicit tlsContext(const char *caFile) :
+        _store(X509_STORE_new())
+    {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        bool loaded = X509_STORE_load_file(_store, caFile) == 1;
+#else
+        bool loaded = X509_STORE_load_locations(_store, caFile, nullptr) == 1;
+#endif
+        if (!loaded)
+        {
+            ERR_clear_error();
+            std::cout << "Could not load " << caFile << ", using the system CA certificates.\n";
+            X509_STORE_set_default_paths(_store);
+        }
+    }
+
+    ~tlsContext()
+    {
+        for (auto &[host, session] : _sessions)
+            SSL_SESSION_free(session);
+        X509_STORE_free(_store);
+    }
+
+    tlsContext(const tlsContext &) = delete;
+    tlsContext &operator=(const tlsContext &) = delete;
+
+    //httplib gives every SSLClient its own SSL_CTX, share what can be shared
+    void configure(httplib::SSLClient &cli, const std::string &domain)
+    {
+        // verification is done by OpenSSL itself (SSL_VERIFY_PEER below), which
+        // keeps httplib from loading the certificates again for every client.
+        cli.enable_server_certificate_verification(false);
+        SSL_CTX *ctx = cli.ssl_context();
+        X509_STORE_up_ref(_store);
+        SSL_CTX_set_cert_store(ctx, _store);
+        SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, verifyCallback);
+        X509_VERIFY_PARAM_set1_host(SSL_CTX_get0_param(ctx), domain.c_str(), domain.size());
+
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx, newSession);
+        SSL_CTX_set_info_callback(ctx, handshakeStart);
+    }
+
+    //certificate error of the last handshake on this thread, 0 if none
+    static long &verifyError()
+    {
+        static thread_local long error {X509_V_OK};
+        return error;
+    }
+
+private:
+    static int verifyCallback(int preverifyOk, X509_STORE_CTX *storeCtx)
+    {
+        if (!preverifyOk)
+            verifyError() = X509_STORE_CTX_get_error(storeCtx);
+        return preverifyOk;
+    }
+
+    static std::string host(const SSL *ssl)
+    {
+        const char *servername = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+        return servername ? servername : "";
+    }
+
+    // called when the server hands out a session (ticket), keep the newest
+    static int newSession(SSL *ssl, SSL_SESSION *session)
+    {
+        auto &tls = Tls();
+        std::lock_guard<std::mutex> lock(tls._mutex);
+        auto &cached = tls._sessions[host(ssl)];
+        if (cached)
+            SSL_SESSION_free(cached);
+        cached = session;
+        return 1; // we keep the reference
+    }
+
+    // httplib offers no hook before SSL_connect, but the handshake start
+    // callback runs before the ClientHello is built, in time to offer the session.
+    static void handshakeStart(const SSL *ssl, int where, int)
+    {
+        if (!(where & SSL_CB_HANDSHAKE_START))
+            return;
+        auto &tls = Tls();
+        std::lock_guard<std::mutex> lock(tls._mutex);
+        auto cached = tls._sessions.find(host(ssl));
+        if (cached != tls._sessions.end())
+            SSL_set_session(const_cast<SSL *>(ssl), cached->second);
+        static const std::array<size_t, 2> lookups = cacheLookupSlots("tls_session");
+        Metrics().add(lookups[cached != tls._sessions.end()]);
+    }
+
+    X509_STORE *_store;
+    std::mutex _mutex;
+    std::map<std::string, SSL_SESSION *> _sessions;
+};
+
+tlsContext &Tls()
+{
+    static tlsContext tls(CA_CERT_FILE);
+    return tls;
+}
+
+//Caches the resolved addresses of the upstream hosts. getaddrinfo does the
+//lookup (so /etc/hosts and nsswitch are honoured) and a DNS query for the
+//A record supplies the TTL; when that query fails the default TTL is used.
+class resolverCache
+{
+public:
+    std::vector<sockaddr_storage> resolve(const std::string &host)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (auto cached = _entries.find(host); cached != _entries.end() && cached->second.expires > std::chrono::steady_clock::now())
+            {
+                countLookup(true);
+                return cached->second.addresses;
+            }
+        }
+        countLookup(false);
+
+        auto resolved = lookup(host);
+        if (!resolved.addresses.empty())
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _entries[host] = {resolved.addresses, std::chrono::steady_clock::now() + resolved.ttl};
+        }
+        return resolved.addresses;
+    }
+
+    void invalidate(const std::string &host)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _entries.erase(host);
+    }
+
+private:
+    static void countLookup(bool hit)
+    {
+        static const std::array<size_t, 2> lookups = cacheLookupSlots("resolver");
+        Metrics().add(lookups[hit]);
+    }
+
+    struct entry
+    {
+        std::vector<sockaddr_storage> addresses;
+        std::chrono::steady_clock::time_point expires;
+    };
+
+    struct resolution
+    {
+        std::vector<sockaddr_storage> addresses;
+        std::chrono::seconds ttl;
+    };
+
+    //The A and AAAA answers carry both the addresses and their TTL, so a
+    //cold lookup costs one round trip per family instead of a getaddrinfo
+    //followed by a second query only for the TTL. Names the DNS does not
+    //answer for (/etc/hosts, localhost) fall back to getaddrinfo with the
+    //default TTL.
+    static resolution lookup(const std::string &host)
+    {
+        resolution resolved {{}, _defaultTtl};
+        struct __res_state state
+        {
+        };
+        if (res_ninit(&state) == 0)
+        {
+            bool found = false;
+            uint32_t ttl = 0;
+            for (auto type : {ns_t_a, ns_t_aaaa})
+            {
+                unsigned char answer[NS_PACKETSZ * 4];
+                int length = res_nquery(&state, host.c_str(), ns_c_in, type, answer, sizeof(answer));
+                ns_msg msg;
+                if (length <= 0 || ns_initparse(answer, length, &msg) != 0)
+                    continue;
+                for (int i = 0; i < ns_msg_count(msg, ns_s_an); ++i)
+                {
+                    ns_rr rr;
+                    if (ns_parserr(&msg, ns_s_an, i, &rr) != 0 || ns_rr_type(rr) != type)
+                        continue;
+                    sockaddr_storage address {};
+                    if (type == ns_t_a && ns_rr_rdlen(rr) == sizeof(in_addr))
+                    {
+                        auto &ipv4 = reinterpret_cast<sockaddr_in &>(address);
+                        ipv4.sin_family = AF_INET;
+                        std::memcpy(&ipv4.sin_addr, ns_rr_rdata(rr), sizeof(in_addr));
+                    }
+                    else if (type == ns_t_aaaa && ns_rr_rdlen(rr) == sizeof(in6_addr))
+                    {
+                        auto &ipv6 = reinterpret_cast<sockaddr_in6 &>(address);
+                        ipv6.sin6_family = AF_INET6;
+                        std::memcpy(&ipv6.sin6_addr, ns_rr_rdata(rr), sizeof(in6_addr));
+                    }
+                    else
+                        continue;
+                    resolved.addresses.push_back(address);
+                    ttl = found ? std::min(ttl, ns_rr_ttl(rr)) : ns_rr_ttl(rr);
+                    found = true;
+                }
+            }
+            res_nclose(&state);
+            if (found)
+            {
+                resolved.ttl = std::chrono::seconds(ttl);
+                return resolved;
+            }
+        }
+
+        addrinfo hints {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo *result = nullptr;
+        if (getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0)
+            return resolved;
+
+        for (auto ai = result; ai; ai = ai->ai_next)
+        {
+            sockaddr_storage address {};
+            std::memcpy(&address, ai->ai_addr, ai->ai_addrlen);
+            resolved.addresses.push_back(address);
+        }
+        freeaddrinfo(result);
+        return resolved;
+    }
+
+    static constexpr std::chrono::seconds _defaultTtl {60};
+    std::mutex _mutex;
+    std::map<std::string, entry> _entries;
+};
+
+resolverCache &Resolver()
+{
+    static resolverCache resolver;
+    return resolver;
+}
+
+//Keep-alive client for one upstream host. It connects to the addresses in
+//the resolver cache and sets up the shared TLS state. connect() only opens
+//the connection (TCP and TLS handshake) so it can be warmed up in advance.
+class upstreamClient : public httplib::SSLClient
+{
+public:
+    explicit upstreamClient(const std::string &domain) :
+        httplib::SSLClient(domain)
+    {
+        Tls().configure(*this, domain);
+        set_keep_alive(true);
+    }
+
+    bool connect()
+    {
+        _connectOnly = true;
+        bool connected = static_cast<bool>(Get("/"));
+        _connectOnly = false;
+        return connected;
+    }
+
+private:
+    bool create_and_connect_socket(Socket &socket, httplib::Error &error) override
+    {
+        if (!is_valid())
+            return false;
+
+        for (auto address : Resolver().resolve(host_))
+        {
+            socklen_t addressLength = sizeof(sockaddr_in);
+            if (address.ss_family == AF_INET6)
+            {
+                reinterpret_cast<sockaddr_in6 &>(address).sin6_port = htons(port_);
+                addressLength = sizeof(sockaddr_in6);
+            }
+            else
+            {
+                reinterpret_cast<sockaddr_in &>(address).sin_port = htons(port_);
+            }
+
+            auto sock = ::socket(address.ss_family, SOCK_STREAM, IPPROTO_TCP);
+            if (sock == INVALID_SOCKET)
+                continue;
+            if (tcp_nodelay_)
+            {
+                int yes = 1;
+                setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+            }
+            if (socket_options_)
+                socket_options_(sock);
+
+            // same as httplib: non blocking connect, bounded by the connection timeout
+            httplib::detail::set_nonblocking(sock, true);
+            if (::connect(sock, reinterpret_cast<sockaddr *>(&address), addressLength) < 0
+                && (httplib::detail::is_connection_error() || !httplib::detail::wait_until_socket_is_ready(sock, connection_timeout_sec_, connection_timeout_usec_)))
+            {
+                httplib::detail::close_socket(sock);
+                continue;
+            }
+            httplib::detail::set_nonblocking(sock, false);
+            socket.sock = sock;
+            error = httplib::Error::Success;
+            return true;
+        }
+
+        Resolver().invalidate(host_);
+        error = httplib::Error::Connection;
+        return false;
+    }
+
+    bool process_socket(const Socket &socket, std::function<bool(httplib::Stream &strm)> callback) override
+    {
+        if (_connectOnly)
+            return true;
+        return httplib::detail::process_client_socket_ssl(
+            socket.ssl, socket.sock, read_timeout_sec_, read_timeout_usec_,
+            write_timeout_sec_, write_timeout_usec_, std::move(callback));
+    }
+
+    bool _connectOnly {false};
+};
+
+//Idle keep-alive clients per host. A fetch takes one out for the duration
+//of a request and hands it back afterwards, so the next request to that
+//host reuses the open connection instead of connecting again.
+class connectionPool
+{
+public:
+    // constructed first so it is destroyed after the pooled clients
+    connectionPool() { Tls(); }
+
+    std::unique_ptr<upstreamClient> acquire(const std::string &domain)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto &idle = _idle[domain];
+            if (!idle.empty())
+            {
+                auto client = std::move(idle.back());
+                idle.pop_back();
+                countLookup(true);
+                return client;
+            }
+        }
+        countLookup(false);
+        return std::make_unique<upstreamClient>(domain);
+    }
+
+    void release(const std::string &domain, std::unique_ptr<upstreamClient> client)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto &idle = _idle[domain];
+        if (idle.size() < _maxIdlePerHost)
+            idle.push_back(std::move(client));
+    }
+
+    //resolve the domains and open connections to them in parallel
+    void warmUp(const std::vector<std::string> &domains, size_t connectionsPerDomain)
+    {
+        std::vector<std::future<void>> connecting;
+        for (const auto &domain : domains)
+        {
+            for (size_t i = 0; i < connectionsPerDomain; ++i)
+            {
+                connecting.push_back(std::async(std::launch::async, [this, domain] {
+                    auto client = acquire(domain);
+                    if (client->connect())
+                        release(domain, std::move(client));
+                }));
+            }
+        }
+    }
+
+private:
+    static void countLookup(bool hit)
+    {
+        static const std::array<size_t, 2> lookups = cacheLookupSlots("connections");
+        Metrics().add(lookups[hit]);
+    }
+
+    static constexpr size_t _maxIdlePerHost = 32;
+    std::mutex _mutex;
+    std::map<std::string, std::vector<std::unique_ptr<upstreamClient>>> _idle;
+};
+
+connectionPool &Connections()
+{
+    static connectionPool pool;
+    return pool;
+}
+
+//A lazily started coroutine producing a T. co_await runs it and gives its
+//value or rethrows its exception, the awaiting coroutine is resumed right
+//where the task finishes (which may be another thread).
+template <typename T>
+class task
+{
+public:
+    struct promise_type
+    {
+        task get_return_object() { return task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct finalAwaiter
+        {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+            {
+                if (auto continuation = handle.promise().continuation)
+                    return continuation;
+                return std::noop_coroutine();
+            }
+            void await_resume() noexcept {};
+        };
+        finalAwaiter final_suspend() noexcept { return {}; }
+
+        void return_value(T result) { value.emplace(std::move(result)); }
+        void unhandled_exception() { error = std::current_exception(); }
+
+        std::optional<T> value;
+        std::exception_ptr error;
+        std::coroutine_handle<> continuation;
+    };
+
+    task(task &&other) noexcept :
+        _handle(std::exchange(other._handle, nullptr)) {};
+    task &operator=(task &&) = delete;
+    ~task()
+    {
+        if (_handle)
+            _handle.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        _handle.promise().continuation = awaiting;
+        return _handle;
+    }
+    T await_resume()
+    {
+        if (_handle.promise().error)
+            std::rethrow_exception(_handle.promise().error);
+        return std::move(*_handle.promise().value);
+    }
+
+private:
+    explicit task(std::coroutine_handle<promise_type> handle) :
+        _handle(handle) {};
+
+    std::coroutine_handle<promise_type> _handle;
+};
+
+//a coroutine nobody waits for, it cleans up after itself
+struct detachedTask
+{
+    struct promise_type
+    {
+        detachedTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {};
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+//Runs coroutines on a fixed set of threads. The blocking calls of a
+//coroutine (http requests) go through io(), which suspends it until a
+//worker has the result, so the number of threads doesn't grow with the
+//number of requests. Waiting for a time (a retry backoff, a deadline) goes
+//through the timers, which hand their job to a worker once it is due, so no
+//worker sleeps.
+class executor
+{
+public:
+    using timer = std::pair<std::chrono::steady_clock::time_point, uint64_t>;
+
+    explicit executor(size_t threads)
+    {
+        for (size_t i = 0; i < threads; ++i)
+            _workers.emplace_back([this] { work(); });
+        _clock = std::thread([this] { tick(); });
+    }
+
+    ~executor()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _changed.notify_all();
+        _timersChanged.notify_all();
+        _clock.join();
+        for (auto &worker : _workers)
+            worker.join();
+    }
+
+    //runs job on a worker
+    void post(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _jobs.push_back(std::move(job));
+        }
+        _changed.notify_one();
+    }
+
+    //runs job on a worker once the time has come, unless it is cancelled before
+    timer at(std::chrono::steady_clock::time_point when, std::function<void()> job)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        timer id {when, _nextTimer++};
+        _timers.emplace(id, std::move(job));
+        _timersChanged.notify_one();
+        return id;
+    }
+
+    //does nothing when the job was handed to a worker already
+    void cancel(const timer &id)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_timers.erase(id) && idle())
+            _idle.notify_all();
+    }
+
+    //co_await sleepUntil(when) resumes the coroutine on a worker at that time
+    auto sleepUntil(std::chrono::steady_clock::time_point when)
+    {
+        struct awaiter
+        {
+            executor &pool;
+            std::chrono::steady_clock::time_point when;
+
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) { pool.at(when, [handle] { handle.resume(); }); }
+            void await_resume() const noexcept {};
+        };
+        return awaiter {*this, when};
+    }
+
+    //co_await io(call) gives the result of call(), made on a worker thread
+    template <typename Call>
+    auto io(Call call)
+    {
+        using result = std::invoke_result_t<Call>;
+        struct awaiter
+        {
+            executor &pool;
+            Call call;
+            std::optional<result> value;
+            std::exception_ptr error;
+
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                pool.post([this, handle] {
+                    try
+                    {
+                        value.emplace(call());
+                    }
+                    catch (...)
+                    {
+                        error = std::current_exception();
+                    }
+                    handle.resume();
+                });
+            }
+            result await_resume()
+            {
+                if (error)
+                    std::rethrow_exception(error);
+                return std::move(*value);
+            }
+        };
+        return awaiter {*this, std::move(call), std::nullopt, nullptr};
+    }
+
+    //blocks until no job is queued, running or waiting for its time, the
+    //requests a whenAllUntil stopped waiting for included
+    void waitIdle()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _idle.wait(lock, [this] { return idle(); });
+    }
+
+    //blocks the calling (non worker) thread until the task is done
+    template <typename T>
+    T run(task<T> work)
+    {
+        std::promise<T> result;
+        auto future = result.get_future();
+        [](task<T> work, std::promise<T> result) -> detachedTask {
+            try
+            {
+                result.set_value(co_await work);
+            }
+            catch (...)
+            {
+                result.set_exception(std::current_exception());
+            }
+        }(std::move(work), std::move(result));
+        return future.get();
+    }
+
+private:
+    [[nodiscard]] bool idle() const { return _jobs.empty() && _busy == 0 && _timers.empty(); }
+
+    //moves the timers that are due to the jobs
+    void tick()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (!_stopping)
+        {
+            if (_timers.empty())
+            {
+                _timersChanged.wait(lock);
+                continue;
+            }
+            auto due = _timers.begin();
+            // a copy, the timer may be cancelled while this waits
+            auto when = due->first.first;
+            if (when > std::chrono::steady_clock::now())
+            {
+                _timersChanged.wait_until(lock, when);
+                continue;
+            }
+            _jobs.push_back(std::move(due->second));
+            _timers.erase(due);
+            _changed.notify_one();
+        }
+    }
+
+    void work()
+    {
+        while (true)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _changed.wait(lock, [this] { return _stopping || !_jobs.empty(); });
+            if (_jobs.empty())
+                return;
+            auto job = std::move(_jobs.front());
+            _jobs.pop_front();
+            ++_busy;
+            lock.unlock();
+            job();
+            lock.lock();
+            if (--_busy == 0 && idle())
+                _idle.notify_all();
+        }
+    }
+
+    std::mutex _mutex;
+    std::condition_variable _changed;
+    std::condition_variable _timersChanged;
+    std::condition_variable _idle;
+    std::deque<std::function<void()>> _jobs;
+    std::map<timer, std::function<void()>> _timers;
+    uint64_t _nextTimer {0};
+    size_t _busy {0};
+    bool _stopping {false};
+    std::vector<std::thread> _workers;
+    std::thread _clock;
+};
+
+executor &Executor()
+{
+    static executor pool(32);
+    return pool;
+}
+
+//Runs all tasks at the same time and gives their values in order, once
+//every one of them finished. The first exception is rethrown afterwards.
+template <typename T>
+task<std::vector<T>> whenAll(std::vector<task<T>> tasks)
+{
+    struct latch
+    {
+        std::atomic<size_t> remaining;
+        std::coroutine_handle<> waiting;
+        std::vector<std::optional<T>> values;
+        std::vector<std::exception_ptr> errors;
+
+        void done()
+        {
+            if (--remaining == 0)
+                waiting.resume();
+        }
+    };
+
+    latch all {tasks.size() + 1, nullptr, std::vector<std::optional<T>>(tasks.size()), std::vector<std::exception_ptr>(tasks.size())};
+    auto start = [](task<T> work, latch &all, size_t index) -> detachedTask {
+        try
+        {
+            all.values[index].emplace(co_await work);
+        }
+        catch (...)
+        {
+            all.errors[index] = std::current_exception();
+        }
+        all.done();
+    };
+    // starts the tasks once this coroutine is suspended. The count includes
+    // this coroutine, so whoever finishes last resumes it.
+    struct starter
+    {
+        std::vector<task<T>> &tasks;
+        latch &all;
+        decltype(start) &startOne;
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            all.waiting = handle;
+            for (size_t i = 0; i < tasks.size(); ++i)
+                startOne(std::move(tasks[i]), all, i);
+            return --all.remaining != 0;
+        }
+        void await_resume() const noexcept {};
+    };
+    co_await starter {tasks, all, start};
+
+    std::vector<T> results;
+    results.reserve(all.values.size());
+    for (size_t i = 0; i < all.values.size(); ++i)
+    {
+        if (all.errors[i])
+            std::rethrow_exception(all.errors[i]);
+        results.push_back(std::move(*all.values[i]));
+    }
+    co_return results;
+}
+
+//whenAll, but it stops waiting at the deadline. A task that hasn't finished
+//by then is empty in the result and ends on its own later, the state it
+//finishes into is shared. Exceptions are rethrown as by whenAll.
+template <typename T>
+task<std::vector<std::optional<T>>> whenAllUntil(std::vector<task<T>> tasks, std::chrono::steady_clock::time_point deadline)
+{
+    struct latch
+    {
+        std::mutex mutex;
+        size_t remaining;
+        bool resumed {false};
+        std::optional<executor::timer> deadline;
+        std::coroutine_handle<> waiting;
+        std::vector<std::optional<T>> values;
+        std::vector<std::exception_ptr> errors;
+
+        //the last task or the deadline resumes the waiting coroutine, whichever is first
+        void done(std::unique_lock<std::mutex> &lock)
+        {
+            if (--remaining != 0 || std::exchange(resumed, true))
+                return;
+            if (deadline)
+                Executor().cancel(*deadline);
+            lock.unlock();
+            waiting.resume();
+        }
+    };
+
+    auto all = std::make_shared<latch>();
+    all->remaining = tasks.size() + 1;
+    all->values.resize(tasks.size());
+    all->errors.resize(tasks.size());
+    auto start = [](task<T> work, std::shared_ptr<latch> all, size_t index) -> detachedTask {
+        std::optional<T> value;
+        std::exception_ptr error;
+        try
+        {
+            value.emplace(co_await work);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        std::unique_lock<std::mutex> lock(all->mutex);
+        all->values[index] = std::move(value);
+        all->errors[index] = error;
+        all->done(lock);
+    };
+    struct starter
+    {
+        std::vector<task<T>> &tasks;
+        std::shared_ptr<latch> &all;
+        decltype(start) &startOne;
+        std::chrono::steady_clock::time_point deadline;
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            all->waiting = handle;
+            for (size_t i = 0; i < tasks.size(); ++i)
+                startOne(std::move(tasks[i]), all, i);
+
+            std::unique_lock<std::mutex> lock(all->mutex);
+            if (--all->remaining == 0)
+            {
+                all->resumed = true;
+                return false;
+            }
+            if (deadline == std::chrono::steady_clock::time_point::max())
+                return true;
+            // the lock keeps the coroutine from being resumed while the timer is set
+            all->deadline = Executor().at(deadline, [all = all] {
+                std::unique_lock<std::mutex> lock(all->mutex);
+                if (std::exchange(all->resumed, true))
+                    return;
+                lock.unlock();
+                all->waiting.resume();
+            });
+            return true;
+        }
+        void await_resume() const noexcept {};
+    };
+    co_await starter {tasks, all, start, deadline};
+
+    std::vector<std::optional<T>> results(tasks.size());
+    std::lock_guard<std::mutex> lock(all->mutex);
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        if (all->errors[i])
+            std::rethrow_exception(all->errors[i]);
+        results[i] = std::move(all->values[i]);
+    }
+    co_return results;
+}
+
+//A condition variable for coroutines, guarded by a mutex of the caller.
+//co_await wait(lock, until) unlocks it and suspends the coroutine until
+//notifyAll() or the given time, then resumes it on a worker without the
+//lock. No thread is held while it waits.
+class coroutineSignal
+{
+public:
+    auto wait(std::unique_lock<std::mutex> &lock, std::chrono::steady_clock::time_point until = std::chrono::steady_clock::time_point::max())
+    {
+        struct awaiter
+        {
+            coroutineSignal &signal;
+            std::unique_lock<std::mutex> &lock;
+            std::chrono::steady_clock::time_point until;
+
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                auto waiting = std::make_shared<waiter>();
+                waiting->handle = handle;
+                signal._waiters.push_back(waiting);
+                auto wakeUp = until;
+                // the coroutine may be resumed (and lock again) once unlocked,
+                // so the lock stops owning the mutex first and only locals are used
+                auto mutex = lock.release();
+                lock = std::unique_lock<std::mutex>(*mutex, std::defer_lock);
+                mutex->unlock();
+                if (wakeUp == std::chrono::steady_clock::time_point::max())
+                    return;
+                std::lock_guard<std::mutex> guard(waiting->mutex);
+                if (!waiting->woken)
+                    waiting->timer = Executor().at(wakeUp, [waiting] {
+                        if (waiting->claim())
+                            waiting->handle.resume();
+                    });
+            }
+            void await_resume() const noexcept {};
+        };
+        return awaiter {*this, lock, until};
+    }
+
+    //the caller holds the mutex given to wait()
+    void notifyAll()
+    {
+        for (auto &waiting : _waiters)
+        {
+            std::lock_guard<std::mutex> guard(waiting->mutex);
+            if (std::exchange(waiting->woken, true))
+                continue;
+            if (waiting->timer)
+                Executor().cancel(*waiting->timer);
+            Executor().post([handle = waiting->handle] { handle.resume(); });
+        }
+        _waiters.clear();
+    }
+
+private:
+    struct waiter
+    {
+        std::mutex mutex;
+        std::coroutine_handle<> handle;
+        bool woken {false};
+        std::optional<executor::timer> timer;
+
+        //whoever wakes the coroutine first resumes it
+        bool claim()
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            return !std::exchange(woken, true);
+        }
+    };
+
+    std::vector<std::shared_ptr<waiter>> _waiters;
+};
+
+//Hedged requests. When a request has produced no response headers after the
+//p95 (or twice the median) of the recent time-to-headers of its domain, an
+//identical request is sent on another connection. Whichever answers first
+//is used and the other one is stopped. Hedges are capped at a tenth of all
+//requests so a slow upstream doesn't get twice the load.
+class requestHedger
+{
+public:
+    void enable() { _enabled = true; }
+    [[nodiscard]] bool enabled() const { return _enabled; }
+
+    //nothing while there are too few samples to tell what slow is
+    std::optional<std::chrono::microseconds> threshold(const std::string &domain)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto &samples = _timeToHeaders[domain];
+        if (samples.size() < _minSamples)
+            return std::nullopt;
+
+        // p95, but at least twice the median so a tight distribution
+        // doesn't hedge requests that are only a little slower than usual
+        std::vector<int64_t> sorted = samples;
+        auto p50 = sorted.begin() + sorted.size() / 2;
+        std::nth_element(sorted.begin(), p50, sorted.end());
+        auto median = *p50;
+        auto p95 = sorted.begin() + (sorted.size() * 95) / 100;
+        std::nth_element(sorted.begin(), p95, sorted.end());
+        return std::chrono::microseconds(std::max(*p95, 2 * median));
+    }
+
+    void observe(const std::string &domain, std::chrono::microseconds timeToHeaders)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto &samples = _timeToHeaders[domain];
+        if (samples.size() < _window)
+            samples.push_back(timeToHeaders.count());
+        else
+            samples[_next[domain]++ % _window] = timeToHeaders.count();
+    }
+
+    bool mayHedge() const { return _hedged * 10 < _requests; }
+
+    void countRequest() { ++_requests; }
+    void countHedge() { ++_hedged; }
+    void countHedgeWin() { ++_hedgeWins; }
+
+    void printStats() const
+    {
+        std::cout << "Hedged requests: " << _hedged << " of " << _requests << " ("
+                  << (_requests ? (_hedged * 100.0 / _requests) : 0.0) << "%), the hedge won "
+                  << _hedgeWins << " times.\n";
+    }
+
+private:
+    static constexpr size_t _minSamples = 20;
+    static constexpr size_t _window = 256;
+    bool _enabled {false};
+    std::atomic<size_t> _requests {0};
+    std::atomic<size_t> _hedged {0};
+    std::atomic<size_t> _hedgeWins {0};
+    std::mutex _mutex;
+    std::map<std::string, std::vector<int64_t>> _timeToHeaders;
+    std::map<std::string, size_t> _next;
+};
+
+requestHedger &Hedger()
+{
+    static requestHedger hedger;
+    return hedger;
+}
+
+//Time budget of a run (--budget). Every fetch gets the remaining time as its
+//socket timeouts and is cancelled once the deadline has passed, getPosts
+//keeps whatever arrived before it.
+class runBudget
+{
+public:
+    void start(std::chrono::milliseconds budget)
+    {
+        _budget = budget;
+        _deadline = std::chrono::steady_clock::now() + budget;
+    }
+
+    //the same budget again from now, track gives every round its own.
+    //Nothing may be fetching while it is restarted.
+    void restart()
+    {
+        if (_deadline)
+            start(_budget);
+    }
+
+    [[nodiscard]] bool limited() const { return _deadline.has_value(); }
+    [[nodiscard]] bool expired() const { return _deadline && std::chrono::steady_clock::now() >= *_deadline; }
+    [[nodiscard]] std::chrono::steady_clock::time_point deadline() const { return _deadline.value_or(std::chrono::steady_clock::time_point::max()); }
+
+    //remaining time, capped at the given default timeout
+    [[nodiscard]] std::chrono::microseconds remaining(std::chrono::microseconds cap) const
+    {
+        if (!_deadline)
+            return cap;
+        auto left = std::chrono::duration_cast<std::chrono::microseconds>(*_deadline - std::chrono::steady_clock::now());
+        return std::clamp(left, std::chrono::microseconds(0), cap);
+    }
+
+    //"5s", "500ms", "2m", a plain number is seconds; the flag names the
+    //option in the error for a value that is not a positive duration
+    static std::chrono::milliseconds parse(const std::string &duration, const std::string &flag)
+    {
+        auto invalid = [&duration, &flag]() { return std::invalid_argument("Invalid --" + flag + " '" + duration + "', use a positive duration like 5s, 500ms or 2m"); };
+        size_t unit = 0;
+        double value = 0;
+        try
+        {
+            value = std::stod(duration, &unit);
+        }
+        catch (const std::logic_error &)
+        {
+            throw invalid();
+        }
+        auto suffix = duration.substr(unit);
+        double scale = 0;
+        if (suffix == "ms")
+            scale = 1;
+        else if (suffix == "m")
+            scale = 60 * 1000;
+        else if (suffix.empty() || suffix == "s")
+            scale = 1000;
+        else
+            throw std::invalid_argument("Unknown --" + flag + " unit '" + suffix + "', use ms, s or m");
+        // also refuses nan and values that round down to no time at all
+        if (!(value * scale >= 1) || value * scale > static_cast<double>(std::chrono::milliseconds::max().count()))
+            throw invalid();
+        return std::chrono::milliseconds(static_cast<long long>(value * scale));
+    }
+
+private:
+    std::chrono::milliseconds _budget {0};
+    std::optional<std::chrono::steady_clock::time_point> _deadline;
+};
+
+runBudget &Budget()
+{
+    static runBudget budget;
+    return budget;
+}
+
+//Adaptive limit on the requests in flight per domain (AIMD). The limit
+//starts in slow start (+1 per good response), after the first congestion
+//signal it grows by 1/limit per good response. A 429, 5xx or connection
+//error halves it, a response slower than twice the fastest recent one
+//takes 10% off, at most once per typical response time. With --rate=N a
+//token bucket additionally allows N requests per second per domain.
+class concurrencyLimiter
+{
+public:
+    //a request slot, given back by done() with the outcome of the request, or
+    //without one by cancel() or when it goes out of scope
+    class permit
+    {
+    public:
+        permit() = default;
+        permit(concurrencyLimiter *limiter, std::string domain) :
+            _limiter(limiter), _domain(std::move(domain)), _start(std::chrono::steady_clock::now()) {};
+        permit(permit &&other) noexcept :
+            _limiter(std::exchange(other._limiter, nullptr)), _domain(std::move(other._domain)), _start(other._start) {};
+        permit &operator=(permit &&) = delete;
+        ~permit() { cancel(); }
+
+        explicit operator bool() const { return _limiter != nullptr; }
+
+        //status 0 means there was no http response
+        void done(int status)
+        {
+            if (auto limiter = std::exchange(_limiter, nullptr))
+                limiter->complete(_domain, std::chrono::steady_clock::now() - _start, status);
+        }
+
+        //the request was not sent or stopped on purpose, the limit stays as it is
+        void cancel()
+        {
+            if (auto limiter = std::exchange(_limiter, nullptr))
+                limiter->release(_domain);
+        }
+
+    private:
+        concurrencyLimiter *_limiter {nullptr};
+        std::string _domain;
+        std::chrono::steady_clock::time_point _start;
+    };
+
+    void setRate(double requestsPerSecond) { _rate = requestsPerSecond; }
+
+    //waits for a slot (and a token) until the run deadline, an empty permit
+    //means the time budget ran out first. The coroutine is suspended while it
+    //waits, it doesn't hold a worker.
+    task<permit> acquire(std::string domain)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true)
+        {
+            if (Budget().expired())
+                co_return permit {};
+
+            auto &state = _domains[domain];
+            auto wakeUp = Budget().deadline();
+            if (state.inFlight < static_cast<size_t>(state.limit))
+            {
+                if (_rate <= 0)
+                    break;
+                refill(state);
+                if (state.tokens >= 1)
+                {
+                    state.tokens -= 1;
+                    break;
+                }
+                auto nextToken = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>((1 - state.tokens) / _rate));
+                wakeUp = std::min(wakeUp, std::chrono::steady_clock::now() + nextToken);
+            }
+            co_await _changed.wait(lock, wakeUp);
+            lock.lock();
+        }
+        ++_domains[domain].inFlight;
+        co_return permit {this, domain};
+    }
+
+private:
+    struct domainState
+    {
+        double limit {_initialLimit};
+        bool slowStart {true};
+        size_t inFlight {0};
+        std::chrono::steady_clock::duration fastest {std::chrono::steady_clock::duration::max()};
+        std::chrono::steady_clock::duration typical {0};
+        size_t samples {0};
+        std::chrono::steady_clock::time_point lastDecrease {};
+        double tokens {std::numeric_limits<double>::infinity()}; // refill() caps it at one second's worth, or one token
+        std::chrono::steady_clock::time_point lastRefill {std::chrono::steady_clock::now()};
+    };
+
+    void refill(domainState &state) const
+    {
+        auto now = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed = now - state.lastRefill;
+        // at least one token, or a rate below one per second never lets a request through
+        state.tokens = std::min(std::max(1.0, _rate), state.tokens + elapsed.count() * _rate);
+        state.lastRefill = now;
+    }
+
+    void release(const std::string &domain)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        --_domains[domain].inFlight;
+        _changed.notifyAll();
+    }
+
+    void complete(const std::string &domain, std::chrono::steady_clock::duration latency, int status)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto &state = _domains[domain];
+        --state.inFlight;
+        _changed.notifyAll();
+
+        // running out of budget says nothing about the upstream
+        if (status == 0 && Budget().expired())
+            return;
+
+        // the fastest response of the last _window, as the no-load latency
+        if (state.samples++ % _window == 0 || latency < state.fastest)
+            state.fastest = latency;
+        state.typical = state.samples == 1 ? latency : (state.typical * 7 + latency) / 8;
+
+        bool congested = status == 0 || status == 429 || status >= 500;
+        bool slow = state.samples > _window / 4 && latency > 2 * state.fastest;
+        auto now = std::chrono::steady_clock::now();
+        if (congested || slow)
+        {
+            // one decrease per typical response time, not one per response
+            if (now - state.lastDecrease < state.typical)
+                return;
+            state.lastDecrease = now;
+            state.slowStart = false;
+            state.limit = std::max(1.0, state.limit * (congested ? 0.5 : 0.9));
+        }
+        else
+        {
+            state.limit = std::min(_maxLimit, state.limit + (state.slowStart ? 1.0 : 1.0 / state.limit));
+        }
+    }
+
+    static constexpr double _initialLimit = 16;
+    static constexpr double _maxLimit = 256;
+    static constexpr size_t _window = 100;
+    double _rate {0};
+    std::mutex _mutex;
+    coroutineSignal _changed;
+    std::map<std::string, domainState> _domains;
+};
+
+concurrencyLimiter &Limiter()
+{
+    static concurrencyLimiter limiter;
+    return limiter;
+}
+
+//Retries for transient failures: no response at all, 408, 429 and 5xx.
+//The delay is a random point below an exponentially growing cap (full
+//jitter) so parallel requests that failed together don't come back
+//together. A Retry-After header is honoured as the minimum delay. No
+//retry is made when the delay doesn't fit in the run budget.
+class retryPolicy
+{
+public:
+    //delay before the next attempt, nothing if the response is final
+    std::optional<std::chrono::milliseconds> delay(int attempt, const httpResponse &response)
+    {
+        using namespace std::chrono;
+        bool transient = response.status == 0 ? !response.permanent : response.status == 408 || response.status == 429 || response.status >= 500;
+        if (!transient || attempt + 1 >= _maxAttempts || Budget().expired())
+            return std::nullopt;
+
+        auto cap = std::min(_maxDelay, _baseDelay * (1 << attempt));
+        milliseconds wait;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            wait = milliseconds(std::uniform_int_distribution<milliseconds::rep>(0, cap.count())(_random));
+        }
+        if (auto retryAfter = parseRetryAfter(response.headers))
+        {
+            if (*retryAfter > _maxDelay)
+                return std::nullopt;
+            wait = std::max(wait, *retryAfter);
+        }
+        if (Budget().limited() && steady_clock::now() + wait >= Budget().deadline())
+            return std::nullopt;
+
+        ++_retried;
+        return wait;
+    }
+
+    [[nodiscard]] size_t retried() const { return _retried; }
+
+    //delay-seconds or an HTTP-date, delay-seconds too large to represent
+    //are the longest delay so no retry is made
+    static std::optional<std::chrono::milliseconds> parseRetryAfter(const httplib::Headers &headers)
+    {
+        auto header = headers.find("Retry-After");
+        if (header == headers.end())
+            return std::nullopt;
+
+        const std::string &value = header->second;
+        if (!value.empty() && std::all_of(value.begin(), value.end(), ::isdigit))
+        {
+            std::chrono::milliseconds::rep seconds = 0;
+            auto [rest, error] = std::from_chars(value.data(), value.data() + value.size(), seconds);
+            if (error == std::errc::result_out_of_range || seconds > std::chrono::milliseconds::max().count() / 1000)
+                return std::chrono::milliseconds::max();
+            return std::chrono::seconds(seconds);
+        }
+
+        std::tm tm {};
+        if (!strptime(value.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm))
+            return std::nullopt;
+        auto at = std::chrono::system_clock::from_time_t(timegm(&tm));
+        return std::max(std::chrono::milliseconds(0), std::chrono::duration_cast<std::chrono::milliseconds>(at - std::chrono::system_clock::now()));
+    }
+
+private:
+    static constexpr int _maxAttempts = 4;
+    static constexpr std::chrono::milliseconds _baseDelay {250};
+    static constexpr std::chrono::milliseconds _maxDelay {10000};
+    std::atomic<size_t> _retried {0};
+    std::mutex _mutex;
+    std::mt19937 _random {std::random_device {}()};
+};
+
+retryPolicy &Retries()
+{
+    static retryPolicy retries;
+    return retries;
+}
+
+//how complete the last getPosts() was
+struct fetchReport
+{
+    friend std::ostream &operator<<(std::ostream &os, const fetchReport &report)
+    {
+        os << report.fetched << " of " << report.requested << " requests completed";
+        if (report.timedOut)
+            os << ", " << report.timedOut << " missed the time budget";
+        if (report.failed)
+            os << ", " << report.failed << " failed";
+        os << ".";
+        const size_t maxErrors = 5;
+        for (size_t i = 0; i < report.errors.size() && i < maxErrors; ++i)
+            os << "\n  " << report.errors[i];
+        if (report.errors.size() > maxErrors)
+            os << "\n  (and " << report.errors.size() - maxErrors << " more errors)";
+        return os;
+    }
+
+    [[nodiscard]] bool complete() const { return fetched == requested; }
+
+    size_t requested {0};
+    size_t fetched {0};
+    size_t timedOut {0};
+    size_t failed {0};
+    std::vector<std::string> errors;
+};
+
+//Maps one json key of a source to a Post member. extract returns false if
+//the value makes the whole item unusable, required fields must be present.
+//Json is json, or countingJson in the test command.
+template <typename Json>
+struct fieldMapping
+{
+    std::string_view key;
+    bool (*extract)(Post &post, const Json &value);
+    bool required {false};
+};
+
+template <typename Json, size_t N>
+constexpr size_t requiredFields(const std::array<fieldMapping<Json>, N> &fields)
+{
+    return std::count_if(fields.begin(), fields.end(), [](const fieldMapping<Json> &field) { return field.required; });
+}
+
+//fills post in a single pass over the object, dispatching every key through
+//the table of the source. Returns false if the item should be skipped.
+template <typename Json, size_t N>
+bool extractPost(const Json &item, const std::array<fieldMapping<Json>, N> &fields, Post &post)
+{
+    if (!item.is_object())
+        return false;
+
+    size_t required = 0;
+    for (const auto &[key, value] : item.template get_ref<const typename Json::object_t &>())
+    {
+        auto field = std::find_if(fields.begin(), fields.end(), [&key = key](const fieldMapping<Json> &f) { return f.key == key; });
+        if (field == fields.end())
+            continue;
+        if (!field->extract(post, value))
+            return false;
+        if (field->required)
+            ++required;
+    }
+    return required == requiredFields(fields);
+}
+
+//The metric slots of a source and its upstream domain, registered when the
+//aggregator is created so the fetch path only adds to them.
+struct aggregatorMetrics
+{
+    aggregatorMetrics(std::string_view source, const std::string &domain)
+    {
+        auto &metrics = Metrics();
+        std::string sourceLabel = "source=\"" + std::string(source) + "\"";
+        std::string domainLabel = "domain=\"" + domain + "\"";
+        getPostsSeconds = metrics.histogram("hn_lob_comp_get_posts_seconds", "Time to fetch all posts of a source.", sourceLabel);
+        parseSeconds = metrics.histogram("hn_lob_comp_parse_seconds", "Time to extract the posts from the fetched JSON.", sourceLabel);
+        postsParsed = metrics.counter("hn_lob_comp_posts_parsed_total", "Posts extracted from the fetched JSON.", sourceLabel);
+        firstOn = metrics.counter("hn_lob_comp_first_on_total", "Matches that appeared first on this site.", sourceLabel);
+        receivedBytes = metrics.counter("hn_lob_comp_received_bytes_total", "Body bytes received from upstream.", domainLabel);
+        fetchSeconds = metrics.histogram("hn_lob_comp_fetch_seconds", "Time until an upstream response was complete.", domainLabel);
+        for (size_t statusClass = 0; statusClass < requests.size(); ++statusClass)
+        {
+            std::string status = statusClass == 0 ? "0" : std::to_string(statusClass) + "xx";
+            requests[statusClass] = metrics.counter("hn_lob_comp_requests_total", "Upstream requests by status class, 0 when there was no response.", domainLabel + ",status=\"" + status + "\"");
+        }
+    }
+
+    //every attempt, by its status class
+    void countResponse(const httpResponse &res) const
+    {
+        auto &metrics = Metrics();
+        metrics.add(requests[res.status >= 100 && res.status < 600 ? res.status / 100 : 0]);
+        metrics.add(receivedBytes, res.body.size());
+        if (res.status != 0)
+            metrics.observe(fetchSeconds, res.elapsed);
+    }
+
+    size_t getPostsSeconds;
+    size_t parseSeconds;
+    size_t postsParsed;
+    size_t firstOn;
+    size_t receivedBytes;
+    size_t fetchSeconds;
+    std::array<size_t, 6> requests {}; // no response, then 1xx to 5xx
+};
+
+class aggregator
+{
+public:
+    aggregator(std::string_view source, const std::string &domain) :
+        _metrics(source, domain) {};
+    virtual ~aggregator() = default;
+    aggregator(const aggregator &) = default;
+    aggregator(aggregator &&) = default;
+    aggregator &operator=(const aggregator &) = default;
+    aggregator &operator=(aggregator &&) = default;
+
+    //posts is only read, the strings are copied once, straight into the arena
+    virtual std::pmr::vector<Post> parsePosts(const json &posts, std::pmr::memory_resource *arena) = 0;
+    virtual task<json> getPosts() = 0;
+    //the posts in one fetched page or item
+    virtual std::pmr::vector<Post> parseDocument(const json &document, std::pmr::memory_resource *arena) = 0;
+    //the current state of these posts, one request per post, as parseDocument reads them
+    virtual task<json> getItems(std::vector<std::string> ids) = 0;
+    //as shown in the report, a short form for the summary and the name spelled
+    //out for the post counts
+    [[nodiscard]] virtual std::string_view name() const = 0;
+    [[nodiscard]] virtual std::string_view shortName() const = 0;
+    [[nodiscard]] virtual std::string_view fullName() const { return name(); }
+
+    task<std::pmr::vector<Post>> fetchPosts(std::pmr::memory_resource *arena)
+    {
+        co_return parsePosts(co_await getPosts(), arena);
+    }
+
+    [[nodiscard]] const fetchReport &report() const { return _report; }
+
+    //called with the posts of every page/item as soon as it arrived, on the executor's threads
+    void onPosts(std::function<void(const std::pmr::vector<Post> &)> callback) { _onPosts = std::move(callback); }
+
+    //one GET on the given connection. onHeaders is called once the status
+    //line and headers are in, returning false from it cancels the request.
+    static httpResponse fetchOnce(upstreamClient &cli, const std::string &url, const std::function<bool()> &onHeaders)
+    {
+        tlsContext::verifyError() = X509_V_OK;
+        httpResponse response;
+        if (Budget().limited())
+        {
+            if (Budget().expired())
+            {
+                response.reason = "the time budget ran out before the request was sent";
+                response.outOfTime = true;
+                return response;
+            }
+            setTimeouts(cli);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        auto res = cli.Get(
+            url.c_str(), httplib::Headers {},
+            [&](const httplib::Response &) {
+                return onHeaders() && !Budget().expired();
+            },
+            [&](const char *data, size_t length) {
+                response.body.append(data, length);
+                return !Budget().expired();
+            });
+        if (res)
+        {
+            response.status = res->status;
+            response.reason = res->reason;
+            response.headers = std::move(res->headers);
+        }
+        else
+        {
+            std::string sslError;
+            if (auto result = tlsContext::verifyError())
+            {
+                sslError += X509_verify_cert_error_string(result);
+                response.permanent = true;
+            }
+
+            response.reason = "httplib error='" + std::to_string((int)res.error()) + "', " + sslError;
+            // cancelled by the callbacks above or a socket timeout cut to the remaining budget
+            response.outOfTime = Budget().expired();
+        }
+        response.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        return response;
+    }
+
+    //socket timeouts of at most the remaining run budget
+    static void setTimeouts(upstreamClient &cli)
+    {
+        using namespace std::chrono;
+        auto timeout = [](seconds defaultTimeout, const std::function<void(time_t, time_t)> &set) {
+            auto remaining = Budget().remaining(defaultTimeout);
+            auto sec = duration_cast<seconds>(remaining);
+            set(sec.count(), (remaining - sec).count());
+        };
+        timeout(seconds(CPPHTTPLIB_CONNECTION_TIMEOUT_SECOND), [&cli](time_t sec, time_t usec) { cli.set_connection_timeout(sec, usec); });
+        timeout(seconds(CPPHTTPLIB_READ_TIMEOUT_SECOND), [&cli](time_t sec, time_t usec) { cli.set_read_timeout(sec, usec); });
+        timeout(seconds(CPPHTTPLIB_WRITE_TIMEOUT_SECOND), [&cli](time_t sec, time_t usec) { cli.set_write_timeout(sec, usec); });
+    }
+
+    //callbacks into one limitedFetch. started runs once the request may go
+    //out and can still cancel it, the client is only valid until finished.
+    //finished returns false when the request was stopped on purpose.
+    struct fetchHooks
+    {
+        std::function<bool(upstreamClient &)> started = [](upstreamClient &) { return true; };
+        std::function<bool()> headers = [] { return true; };
+        std::function<bool()> finished = [] { return true; };
+    };
+
+    //one request within the concurrency limit of the domain, on a pooled
+    //connection. Only the request itself takes a worker.
+    static task<httpResponse> limitedFetch(std::string domain, std::string url, fetchHooks hooks)
+    {
+        auto permit = co_await Limiter().acquire(domain);
+        if (!permit)
+        {
+            httpResponse response;
+            response.reason = "the time budget ran out before the request was sent";
+            response.outOfTime = true;
+            co_return response;
+        }
+
+        co_return co_await Executor().io([&] {
+            httpResponse response;
+            auto cli = Connections().acquire(domain);
+            if (!hooks.started(*cli))
+            {
+                response.reason = "cancelled";
+                return response;
+            }
+            response = fetchOnce(*cli, url, hooks.headers);
+            if (hooks.finished() || response.status != 0)
+                permit.done(response.status);
+            else
+                permit.cancel();
+            if (response.status != 0)
+                Connections().release(domain, std::move(cli));
+            return response;
+        });
+    }
+
+    static task<httpResponse> fetch(std::string domain, std::string url)
+    {
+        if (Hedger().enabled())
+            co_return co_await hedgedFetch(std::move(domain), std::move(url));
+
+        co_return co_await limitedFetch(std::move(domain), std::move(url), {});
+    }
+
+    //races a second request against a slow first one, see requestHedger
+    static task<httpResponse> hedgedFetch(std::string domain, std::string url)
+    {
+        struct race
+        {
+            std::mutex mutex;
+            coroutineSignal changed; // wakes hedgedFetch
+            std::condition_variable stopped; // wakes an attempt whose client is being stopped
+            std::array<upstreamClient *, 2> clients {};
+            std::optional<std::chrono::steady_clock::time_point> sent;
+            bool headers {false};
+            bool stopping {false};
+            int launched {1};
+            int finished {0};
+            int winner {-1};
+            httpResponse response;
+        };
+        auto state = std::make_shared<race>();
+
+        // nobody waits for the loser of a race, it ends on its own
+        auto attempt = [](std::shared_ptr<race> state, std::string domain, std::string url, int index) -> detachedTask {
+            std::chrono::steady_clock::time_point sent;
+            fetchHooks hooks;
+            hooks.started = [&](upstreamClient &cli) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                sent = std::chrono::steady_clock::now();
+                if (index == 0)
+                    state->sent = sent;
+                if (state->winner != -1)
+                    return false;
+                state->clients[index] = &cli;
+                state->changed.notifyAll();
+                return true;
+            };
+            hooks.headers = [&] {
+                Hedger().observe(domain, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - sent));
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->headers = true;
+                state->changed.notifyAll();
+                return state->winner == -1;
+            };
+            // the winner may be stopping this client, it has to stay valid until then
+            hooks.finished = [&] {
+                std::unique_lock<std::mutex> lock(state->mutex);
+                state->stopped.wait(lock, [&] { return !state->stopping; });
+                state->clients[index] = nullptr;
+                return state->winner == -1 || state->winner == index;
+            };
+            auto response = co_await limitedFetch(domain, url, hooks);
+
+            std::unique_lock<std::mutex> lock(state->mutex);
+            state->clients[index] = nullptr;
+            ++state->finished;
+            upstreamClient *other = nullptr;
+            if (state->winner == -1 && (response.status != 0 || state->finished == state->launched))
+            {
+                state->winner = index;
+                state->response = std::move(response);
+                other = state->clients[1 - index];
+                state->stopping = other != nullptr;
+            }
+            state->changed.notifyAll();
+            if (!other)
+                co_return;
+
+            // stop() waits for a connect in progress, so not while holding the lock
+            lock.unlock();
+            other->stop();
+            lock.lock();
+            state->stopping = false;
+            state->stopped.notify_all();
+        };
+
+        Hedger().countRequest();
+        attempt(state, domain, url, 0);
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        while (state->winner == -1)
+        {
+            // the clock starts once the first request got its slot and went out
+            auto wakeUp = std::chrono::steady_clock::time_point::max();
+            if (state->sent && state->launched == 1 && !state->headers)
+            {
+                auto now = std::chrono::steady_clock::now();
+                auto threshold = Hedger().threshold(domain);
+                if (threshold && now - *state->sent >= *threshold && Hedger().mayHedge())
+                {
+                    state->launched = 2;
+                    Hedger().countHedge();
+                    lock.unlock();
+                    attempt(state, domain, url, 1);
+                    lock.lock();
+                    continue;
+                }
+                // re-evaluate at least every 50ms, the threshold moves as samples arrive
+                wakeUp = now + std::chrono::milliseconds(50);
+                if (threshold)
+                    wakeUp = std::min(wakeUp, *state->sent + *threshold);
+            }
+            co_await state->changed.wait(lock, wakeUp);
+            lock.lock();
+        }
+        if (state->winner == 1)
+            Hedger().countHedgeWin();
+        auto response = std::move(state->response);
+        lock.unlock();
+        co_return response;
+    }
+
+    static task<json> getJson(std::string domain, std::string url, aggregatorMetrics metrics)
+    {
+        httpResponse res;
+        for (int attempt = 0;; ++attempt)
+        {
+            if (Traffic().replaying())
+                res = co_await Executor().io([&] { return Traffic().replay(domain, url); });
+            else
+                res = co_await fetch(domain, url);
+            if (Traffic().recording())
+                Traffic().record(domain, url, res);
+            metrics.countResponse(res);
+
+            auto delay = Retries().delay(attempt, res);
+            if (!delay)
+                break;
+            // a replay serves the recorded attempts in order, without the wait
+            if (!Traffic().replaying())
+                co_await Executor().sleepUntil(std::chrono::steady_clock::now() + *delay);
+        }
+
+        if (res.status == 0 && res.outOfTime)
+            throw budgetExpired("HTTP Request failed. domain='" + domain + "', url='" + url + "', " + res.reason);
+
+        if (res.status == 0)
+            throw httpException("HTTP Request failed. domain='" + domain + "', url='" + url + "', " + res.reason);
+
+        if (res.status != 200)
+            throw httpException("HTTP Request failed. domain='" + domain + "', url='" + url + "', status code='" + std::to_string(res.status) + "', reason='" + res.reason + "'");
+
+        co_return json::parse(res.body);
+    }
+
+    [[nodiscard]] const aggregatorMetrics &metrics() const { return _metrics; }
+
+protected:
+    metricsRegistry::scopedTimer getPostsTimer() const { return Metrics().timer(_metrics.getPostsSeconds); }
+    metricsRegistry::scopedTimer parseTimer() const { return Metrics().timer(_metrics.parseSeconds); }
+    void countParsed(size_t posts) const { Metrics().add(_metrics.postsParsed, posts); }
+
+    //the response of a single request, or why there is none
+    struct fetchOutcome
+    {
+        std::optional<json> value;
+        std::string error;
+        bool timedOut {false}; // the error is the time budget running out
+    };
+
+    //getJson on the executor, prepare runs on the response before it is kept
+    static task<fetchOutcome> tryGetJson(aggregatorMetrics metrics, std::string domain, std::string url, void (*prepare)(json &) = nullptr)
+    {
+        fetchOutcome outcome;
+        try
+        {
+            json response = co_await getJson(domain, url, metrics);
+            if (prepare)
+                prepare(response);
+            outcome.value = std::move(response);
+        }
+        catch (const budgetExpired &e)
+        {
+            outcome.error = e.what();
+            outcome.timedOut = true;
+        }
+        catch (const std::exception &e)
+        {
+            outcome.error = e.what();
+        }
+        co_return outcome;
+    }
+
+    //the aggregator a fetchAll delivers posts to, until it stopped waiting
+    struct postDelivery
+    {
+        std::mutex mutex;
+        aggregator *target;
+    };
+
+    //tryGetJson, handing the posts to the onPosts callback right away
+    static task<fetchOutcome> fetchOne(std::shared_ptr<postDelivery> delivery, aggregatorMetrics metrics, std::string domain, std::string url, void (*prepare)(json &))
+    {
+        auto outcome = co_await tryGetJson(metrics, std::move(domain), std::move(url), prepare);
+        {
+            std::lock_guard<std::mutex> lock(delivery->mutex);
+            if (auto target = delivery->target; outcome.value && target && target->_onPosts)
+                target->_onPosts(target->parseDocument(*outcome.value, std::pmr::get_default_resource()));
+        }
+        co_return outcome;
+    }
+
+    //Fetches all urls at the same time and keeps whatever arrived by the run
+    //deadline, in the order of urls. A failed or late page/item is recorded
+    //in the report instead of failing the whole run.
+    task<json> fetchAll(std::string domain, std::vector<std::string> urls, void (*prepare)(json &) = nullptr)
+    {
+        // a fetch that ends after the deadline may outlive this aggregator
+        auto delivery = std::make_shared<postDelivery>();
+        delivery->target = this;
+        std::vector<task<fetchOutcome>> fetches;
+        fetches.reserve(urls.size());
+        for (const auto &url : urls)
+            fetches.push_back(fetchOne(delivery, _metrics, domain, url, prepare));
+        _report.requested += urls.size();
+
+        auto outcomes = co_await whenAllUntil(std::move(fetches), Budget().deadline());
+        {
+            std::lock_guard<std::mutex> lock(delivery->mutex);
+            delivery->target = nullptr;
+        }
+
+        json posts = json::array();
+        // move every page/item into the result, the DOM is never copied
+        posts.get_ref<json::array_t &>().reserve(urls.size());
+        for (auto &outcome : outcomes)
+        {
+            if (!outcome)
+            {
+                ++_report.timedOut;
+                continue;
+            }
+            if (outcome->value)
+            {
+                posts.push_back(std::move(*outcome->value));
+                ++_report.fetched;
+            }
+            else
+            {
+                countFailure(*outcome);
+            }
+        }
+        co_return posts;
+    }
+
+    //a request that ended without a response, because of the time budget or an error
+    void countFailure(fetchOutcome &outcome)
+    {
+        if (outcome.timedOut)
+        {
+            ++_report.timedOut;
+            return;
+        }
+        ++_report.failed;
+        _report.errors.push_back(std::move(outcome.error));
+    }
+
+    aggregatorMetrics _metrics;
+    fetchReport _report;
+    std::function<void(const std::pmr::vector<Post> &)> _onPosts;
+};
+
+class lobsters : public aggregator
+{
+public:
+    explicit lobsters(std::string domain, std::string url) :
+        aggregator("Lobsters", domain), _domain(std::move(domain)), _url(std::move(url)) {};
+
+    [[nodiscard]] std::string_view name() const override { return "Lobsters"; }
+    [[nodiscard]] std::string_view shortName() const override { return "Lobsters"; }
+    // created_at format: 2020-12-28T00:22:26.000-06:00
+    template <typename Json>
+    static bool parseCreatedAt(Post &post, const Json &value)
+    {
+        const auto &dateStr = value.template get_ref<const std::string &>();
+        // %z doesnt like the colon in the timezone, copy without it
+        char date[64] {""};
+        if (dateStr.size() <= 26 || dateStr.size() >= sizeof(date))
+            return false;
+        std::copy(dateStr.begin(), dateStr.begin() + 26, date);
+        std::copy(dateStr.begin() + 27, dateStr.end(), date + 26);
+
+        struct tm cst
+        {
+            0
+        };
+        auto lobsters_convert = strptime(date, "%Y-%m-%dT%H:%M:%S.000%z", &cst);
+        if (!lobsters_convert || lobsters_convert[0]) // strptime failed to convert
+            return false;
+
+        // timegm updates the static storage, copy it first.
+        auto lobsters_utc_offset = cst.tm_gmtoff; // gcc extension
+        time_t lobsters_epoch_without_timezone_offset = timegm(&cst); // epoch is in utc, so use timegm instead of mktime
+        post.submit_timestamp = difftime(lobsters_epoch_without_timezone_offset, lobsters_utc_offset);
+        return true;
+    }
+
+    template <typename Json>
+    static constexpr std::array<fieldMapping<Json>, 8> fields {{
+        {"comment_count", [](Post &p, const Json &v) { p.comment_count = v.template get<int>(); return true; }},
+        {"comments_url", [](Post &p, const Json &v) { p.comment_url = v.template get_ref<const std::string &>(); return true; }},
+        {"score", [](Post &p, const Json &v) { p.votes = v.template get<int>(); return true; }},
+        {"title", [](Post &p, const Json &v) { p.title = v.template get_ref<const std::string &>(); return true; }},
+        {"url", [](Post &p, const Json &v) { p.original_url = v.template get_ref<const std::string &>(); return true; }, true},
+        {"short_id", [](Post &p, const Json &v) { p.id = v.template get_ref<const std::string &>(); return true; }},
+        {"created_at", parseCreatedAt<Json>},
+        {"submitter_user", [](Post &p, const Json &v) {
+             if (auto username = v.find("username"); username != v.end())
+                 p.submitter = username->template get_ref<const std::string &>();
+             return true;
+         }},
+    }};
+
+    std::pmr::vector<Post> parsePosts(const json &posts, std::pmr::memory_resource *arena) override
+    {
+        auto timer = parseTimer();
+        auto result = extractPosts(posts, arena);
+        countParsed(result.size());
+        return result;
+    }
+
+    //the posts of all pages, the DOM is only read
+    template <typename Json>
+    static std::pmr::vector<Post> extractPosts(const Json &posts, std::pmr::memory_resource *arena)
+    {
+        std::pmr::vector<Post> result(arena);
+        result.reserve(std::accumulate(posts.cbegin(), posts.cend(), size_t {0}, [](size_t sum, const Json &page) { return sum + page.size(); }));
+        for (const auto &page : posts)
+        {
+            for (const auto &item : page)
+            {
+                Post p(result.get_allocator());
+                if (extractPost(item, fields<Json>, p))
+                    result.push_back(std::move(p));
+            }
+        }
+        return result;
+    }
+
+    std::pmr::vector<Post> parseDocument(const json &page, std::pmr::memory_resource *arena) override
+    {
+        std::pmr::vector<Post> result(arena);
+        result.reserve(page.size());
+        for (const auto &item : page)
+        {
+            Post p(result.get_allocator());
+            if (extractPost(item, fields<json>, p))
+                result.push_back(std::move(p));
+        }
+        return result;
+    }
+
+    task<json> getItems(std::vector<std::string> ids) override
+    {
+        _report = {};
+        std::vector<std::string> urls;
+        urls.reserve(ids.size());
+        for (const auto &id : ids)
+            urls.push_back("/s/" + id + ".json");
+        co_return co_await fetchAll(_domain, urls, storyAsPage);
+    }
+
+    //fetch pages until they are older than this instead of a fixed number of pages
+    void fetchUntil(time_t oldest) { _fetchUntil = oldest; }
+
+    task<json> getPosts() override
+    {
+        auto timer = getPostsTimer();
+        _report = {};
+        if (_fetchUntil)
+            co_return co_await getPostsUntil(*_fetchUntil);
+
+        std::vector<std::string> urls;
+        int maxPages = 9;
+        for (int i = 1; i < maxPages; ++i)
+            urls.push_back(pageUrl(i));
+
+        co_return co_await fetchAll(_domain, urls);
+    }
+
+private:
+    //a single story comes with all its comments, keep it as a page with just the story
+    static void storyAsPage(json &story)
+    {
+        if (story.is_object())
+            story.erase("comments");
+        json page = json::array();
+        page.push_back(std::move(story));
+        story = std::move(page);
+    }
+
+    [[nodiscard]] std::string pageUrl(int page) const
+    {
+        return std::regex_replace(_url, std::regex("%PAGENUMBER%"), std::to_string(page));
+    }
+
+    //Fetches pages a few at a time until a batch reaches a day before
+    //oldest, or the listing ends. A Lobsters post that much older than
+    //everything on the other site is not expected to match anymore.
+    task<json> getPostsUntil(time_t oldest)
+    {
+        const int pagesPerBatch = 4;
+        const int maxPages = 40;
+        const time_t slack = 24 * 60 * 60;
+
+        json posts = json::array();
+        for (int first = 1; first <= maxPages && !Budget().expired(); first += pagesPerBatch)
+        {
+            std::vector<std::string> urls;
+            for (int i = first; i < first + pagesPerBatch && i <= maxPages; ++i)
+                urls.push_back(pageUrl(i));
+
+            json batch = co_await fetchAll(_domain, urls);
+            bool listingEnded = false;
+            time_t batchOldest = std::numeric_limits<time_t>::max();
+            for (auto &page : batch.get_ref<json::array_t &>())
+            {
+                listingEnded |= page.empty();
+                for (const auto &item : page)
+                {
+                    Post post;
+                    auto createdAt = item.find("created_at");
+                    if (createdAt != item.end() && createdAt->is_string() && parseCreatedAt(post, *createdAt))
+                        batchOldest = std::min(batchOldest, post.submit_timestamp);
+                }
+                posts.push_back(std::move(page));
+            }
+            if (listingEnded || batchOldest < oldest - slack)
+                break;
+        }
+        co_return posts;
+    }
+
+    std::optional<time_t> _fetchUntil;
+    std::string _url;
+    std::string _domain;
+};
+
+class hackernews : public aggregator
+{
+public:
+    explicit hackernews(std::string domain, std::string id_url, std::string story_url, size_t maxPosts = 200) :
+        aggregator("HN", domain), _maxPosts(maxPosts), _domain(std::move(domain)), _id_url(std::move(id_url)), _story_url(std::move(story_url)) {};
+
+    [[nodiscard]] std::string_view name() const override { return "HackerNews"; }
+    [[nodiscard]] std::string_view shortName() const override { return "HN"; }
+    [[nodiscard]] std::string_view fullName() const override { return "Hacker News"; }
+
+    template <typename Json>
+    static constexpr std::array<fieldMapping<Json>, 8> fields {{
+        {"type", [](Post &, const Json &v) { return v.template get_ref<const std::string &>() == "story"; }, true},
+        {"url", [](Post &p, const Json &v) { p.original_url = v.template get_ref<const std::string &>(); return true; }, true},
+        {"descendants", [](Post &p, const Json &v) { p.comment_count = v.template get<int>(); return true; }},
+        {"score", [](Post &p, const Json &v) { p.votes = v.template get<int>(); return true; }},
+        {"title", [](Post &p, const Json &v) { p.title = v.template get_ref<const std::string &>(); return true; }},
+        {"by", [](Post &p, const Json &v) { p.submitter = v.template get_ref<const std::string &>(); return true; }},
+        {"id", [](Post &p, const Json &v) {
+             p.id = std::to_string(v.template get<long long>());
+             p.comment_url = "https://news.ycombinator.com/item?id=";
+             p.comment_url += p.id;
+             return true;
+         }},
+        // format: 1609012592 (epoch) (epoch is always utc)
+        {"time", [](Post &p, const Json &v) { p.submit_timestamp = v.template get<long long>(); return true; }},
+    }};
+
+    std::pmr::vector<Post> parsePosts(const json &posts, std::pmr::memory_resource *arena) override
+    {
+        auto timer = parseTimer();
+        auto result = extractPosts(posts, arena);
+        countParsed(result.size());
+        return result;
+    }
+
+    //the posts of all items, the DOM is only read
+    template <typename Json>
+    static std::pmr::vector<Post> extractPosts(const Json &posts, std::pmr::memory_resource *arena)
+    {
+        std::pmr::vector<Post> result(arena);
+        result.reserve(posts.size());
+        for (const auto &item : posts)
+        {
+            Post p(result.get_allocator());
+            if (extractPost(item, fields<Json>, p))
+                result.push_back(std::move(p));
+        }
+        return result;
+    }
+
+    std::pmr::vector<Post> parseDocument(const json &item, std::pmr::memory_resource *arena) override
+    {
+        std::pmr::vector<Post> result(arena);
+        Post p(result.get_allocator());
+        if (extractPost(item, fields<json>, p))
+            result.push_back(std::move(p));
+        return result;
+    }
+
+    task<json> getPosts() override
+    {
+        auto timer = getPostsTimer();
+        _report = {};
+        _report.requested = 1;
+        auto ids = co_await tryGetJson(_metrics, _domain, _id_url);
+        if (!ids.value)
+        {
+            countFailure(ids);
+            co_return json::array();
+        }
+
+        std::vector<std::string> urls;
+        urls.reserve(std::min(ids.value->size(), _maxPosts));
+        for (const auto &id : *ids.value)
+        {
+            if (urls.size() == _maxPosts)
+                break;
+            std::string postId = std::to_string(id.get<long long>());
+            urls.push_back(std::regex_replace(_story_url, std::regex("%ID%"), postId));
+        }
+
+        json posts = co_await fetchAll(_domain, urls, dropUnusedFields);
+        ++_report.fetched; // the id list
+        co_return posts;
+    }
+
+    task<json> getItems(std::vector<std::string> ids) override
+    {
+        _report = {};
+        std::vector<std::string> urls;
+        urls.reserve(ids.size());
+        for (const auto &id : ids)
+            urls.push_back(std::regex_replace(_story_url, std::regex("%ID%"), id));
+        co_return co_await fetchAll(_domain, urls, dropUnusedFields);
+    }
+
+    struct listRequest
+    {
+        std::string name;
+        size_t depth;
+    };
+
+    struct storyList
+    {
+        std::string name;
+        std::pmr::vector<Post> posts;
+    };
+
+    //Fetches several story lists (top, best, new, show, ask, job), each
+    //limited to its own depth. An item on more than one list is fetched
+    //and parsed once, every list gets its own copy of the Post.
+    task<std::vector<storyList>> getLists(std::vector<listRequest> requests, std::pmr::memory_resource *arena)
+    {
+        _report = {};
+        _report.requested = requests.size();
+        std::vector<task<fetchOutcome>> idFetches;
+        for (const auto &request : requests)
+            idFetches.push_back(tryGetJson(_metrics, _domain, "/v0/" + request.name + "stories.json"));
+        auto idLists = co_await whenAll(std::move(idFetches));
+
+        // every id once, in order of first appearance
+        std::vector<std::vector<std::string>> listIds(requests.size());
+        std::unordered_set<std::string> seen;
+        std::vector<std::string> urls;
+        for (size_t list = 0; list < requests.size(); ++list)
+        {
+            if (!idLists[list].value)
+            {
+                countFailure(idLists[list]);
+                continue;
+            }
+            ++_report.fetched;
+            for (const auto &id : *idLists[list].value)
+            {
+                if (listIds[list].size() == requests[list].depth)
+                    break;
+                std::string postId = std::to_string(id.get<long long>());
+                if (seen.insert(postId).second)
+                    urls.push_back(std::regex_replace(_story_url, std::regex("%ID%"), postId));
+                listIds[list].push_back(std::move(postId));
+            }
+        }
+
+        std::pmr::vector<Post> items = parsePosts(co_await fetchAll(_domain, urls, dropUnusedFields), arena);
+        std::unordered_map<std::string_view, const Post *> itemCache;
+        for (const auto &item : items)
+            itemCache.emplace(item.id, &item);
+
+        std::vector<storyList> lists;
+        for (size_t list = 0; list < requests.size(); ++list)
+        {
+            storyList &result = lists.emplace_back(storyList {requests[list].name, std::pmr::vector<Post>(arena)});
+            result.posts.reserve(listIds[list].size());
+            for (const auto &id : listIds[list])
+            {
+                if (auto item = itemCache.find(id); item != itemCache.end())
+                    result.posts.push_back(*item->second);
+            }
+        }
+        co_return lists;
+    }
+
+private:
+    //items carry e.g. the ids of all comments, only keep what fields reads
+    static void dropUnusedFields(json &item)
+    {
+        if (!item.is_object())
+            return;
+        auto &object = item.get_ref<json::object_t &>();
+        for (auto it = object.begin(); it != object.end();)
+        {
+            bool used = std::any_of(fields<json>.begin(), fields<json>.end(), [&it](const fieldMapping<json> &field) { return field.key == it->first; });
+            it = used ? std::next(it) : object.erase(it);
+        }
+    }
+
+    size_t _maxPosts;
+    std::string _id_url;
+    std::string _story_url;
+    std::string _domain;
+};
+
+void printTm(const tm *tp);
+void printCurrentDate()
+{
+    time_t t_now = time(nullptr);
+    tm *tm_now = localtime(&t_now);
+    char now[200] {""};
+    strftime(now, sizeof(now), "%Y-%m-%dT%H:%M:%S %z", tm_now);
+    std::cout << "Current date/time: " << now << "\n\n";
+}
+
+void printTm(const tm *tp)
+{
+    if (tp->tm_yday > 0)
+        std::cout << tp->tm_yday << " days, ";
+    if (tp->tm_hour > 0)
+        std::cout << tp->tm_hour << " hours, ";
+    if (tp->tm_min > 0)
+        std::cout << tp->tm_min << " minutes, ";
+    if (tp->tm_sec > 0)
+        std::cout << tp->tm_sec << " seconds ";
+}
+
+//Count, mean, variance, min and max in constant memory (Welford), and
+//percentiles from a histogram with logarithmic buckets that are within 1%
+//of the value (the DDSketch idea), a few hundred buckets cover
+//everything from seconds to years. Stats merge into the stats of both
+//inputs, so they can be kept per thread or per run and combined later.
+class runningStats
+{
+public:
+    void add(double value)
+    {
+        ++_count;
+        double delta = value - _mean;
+        _mean += delta / _count;
+        _m2 += delta * (value - _mean);
+        _min = std::min(_min, value);
+        _max = std::max(_max, value);
+
+        if (std::abs(value) < _smallest)
+            ++_zeros;
+        else if (value > 0)
+            ++_positive[bucketOf(value)];
+        else
+            ++_negative[bucketOf(-value)];
+    }
+
+    void merge(const runningStats &other)
+    {
+        if (other._count == 0)
+            return;
+        // Chan et al., the parallel form of Welford's update
+        size_t count = _count + other._count;
+        double delta = other._mean - _mean;
+        _m2 += other._m2 + delta * delta * _count * other._count / count;
+        _mean += delta * other._count / count;
+        _count = count;
+        _min = std::min(_min, other._min);
+        _max = std::max(_max, other._max);
+
+        _zeros += other._zeros;
+        for (auto [bucket, counted] : other._positive)
+            _positive[bucket] += counted;
+        for (auto [bucket, counted] : other._negative)
+            _negative[bucket] += counted;
+    }
+
+    [[nodiscard]] size_t count() const { return _count; }
+    [[nodiscard]] double mean() const { return _mean; }
+    [[nodiscard]] double variance() const { return _count > 1 ? _m2 / (_count - 1) : 0; }
+    [[nodiscard]] double min() const { return _min; }
+    [[nodiscard]] double max() const { return _max; }
+
+    //fraction between 0 and 1, e.g. 0.99 for p99
+    [[nodiscard]] double percentile(double fraction) const
+    {
+        if (_count == 0)
+            return 0;
+        auto rank = static_cast<uint64_t>(fraction * (_count - 1));
+        uint64_t seen = 0;
+        for (auto bucket = _negative.rbegin(); bucket != _negative.rend(); ++bucket)
+        {
+            seen += bucket->second;
+            if (seen > rank)
+                return std::clamp(-valueOf(bucket->first), _min, _max);
+        }
+        seen += _zeros;
+        if (seen > rank)
+            return 0;
+        for (auto [bucket, count] : _positive)
+        {
+            seen += count;
+            if (seen > rank)
+                return std::clamp(valueOf(bucket), _min, _max);
+        }
+        return _max;
+    }
+
+private:
+    static constexpr double _accuracy = 0.01;
+    static constexpr double _gamma = (1 + _accuracy) / (1 - _accuracy);
+    static constexpr double _smallest = 1e-9;
+
+    static int bucketOf(double value) { return static_cast<int>(std::ceil(std::log(value) / std::log(_gamma))); }
+    //the value with the smallest relative error for everything in the bucket
+    static double valueOf(int bucket) { return 2 * std::pow(_gamma, bucket) / (_gamma + 1); }
+
+    size_t _count {0};
+    double _mean {0};
+    double _m2 {0};
+    double _min {std::numeric_limits<double>::infinity()};
+    double _max {-std::numeric_limits<double>::infinity()};
+    uint64_t _zeros {0};
+    std::map<int, uint64_t> _positive;
+    std::map<int, uint64_t> _negative;
+};
+
+//The (time, votes, comments) samples of one post over time. Every sample
+//is stored as its difference to the previous one, zigzag and varint
+//encoded, so a sample of a post that gained a few votes in a few minutes
+//takes about 4 bytes instead of 16.
+class velocitySeries
+{
+public:
+    struct sample
+    {
+        time_t time {0};
+        int votes {0};
+        int comments {0};
+    };
+
+    void add(const sample &next)
+    {
+        if (_count == 0)
+            _first = next;
+        put(next.time - _last.time);
+        put(next.votes - _last.votes);
+        put(next.comments - _last.comments);
+        _last = next;
+        ++_count;
+    }
+
+    [[nodiscard]] std::vector<sample> samples() const
+    {
+        std::vector<sample> result;
+        result.reserve(_count);
+        sample current;
+        for (size_t at = 0; at < _bytes.size();)
+        {
+            current.time += get(at);
+            current.votes += static_cast<int>(get(at));
+            current.comments += static_cast<int>(get(at));
+            result.push_back(current);
+        }
+        return result;
+    }
+
+    [[nodiscard]] size_t size() const { return _count; }
+    [[nodiscard]] size_t bytes() const { return _bytes.size(); }
+    [[nodiscard]] const sample &first() const { return _first; }
+    [[nodiscard]] const sample &last() const { return _last; }
+
+    //votes and comments gained per hour between the first and the last sample
+    [[nodiscard]] std::optional<std::pair<double, double>> perHour() const
+    {
+        double hours = static_cast<double>(_last.time - _first.time) / 3600;
+        if (_count < 2 || hours <= 0)
+            return std::nullopt;
+        return std::make_pair((_last.votes - _first.votes) / hours, (_last.comments - _first.comments) / hours);
+    }
+
+    //the fastest vote growth between two consecutive samples, per hour
+    [[nodiscard]] std::optional<double> peakVotesPerHour() const
+    {
+        std::optional<double> peak;
+        auto all = samples();
+        for (size_t i = 1; i < all.size(); ++i)
+        {
+            if (all[i].time > all[i - 1].time)
+                peak = std::max(peak.value_or(std::numeric_limits<double>::lowest()), (all[i].votes - all[i - 1].votes) * 3600.0 / (all[i].time - all[i - 1].time));
+        }
+        return peak;
+    }
+
+private:
+    void put(int64_t delta)
+    {
+        auto zigzag = (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63);
+        for (; zigzag >= 0x80; zigzag >>= 7)
+            _bytes.push_back(static_cast<uint8_t>(zigzag | 0x80));
+        _bytes.push_back(static_cast<uint8_t>(zigzag));
+    }
+
+    [[nodiscard]] int64_t get(size_t &at) const
+    {
+        uint64_t zigzag = 0;
+        for (int shift = 0; at < _bytes.size(); shift += 7)
+        {
+            uint8_t byte = _bytes[at++];
+            zigzag |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                break;
+        }
+        return static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+    }
+
+    std::vector<uint8_t> _bytes;
+    sample _first;
+    sample _last;
+    size_t _count {0};
+};
+
+//submit time of the oldest post, the table must not be empty
+time_t oldestSubmission(const PostTable &table)
+{
+    time_t oldest = table.submit_timestamp(0);
+    for (size_t row = 1; row < table.size(); ++row)
+        oldest = std::min(oldest, table.submit_timestamp(row));
+    return oldest;
+}
+
+struct postMatch
+{
+    size_t firstRow;
+    size_t secondRow;
+};
+
+//A source to compare and the posts fetched from it
+struct sourceTable
+{
+    const aggregator &source;
+    const PostTable &posts;
+};
+
+struct appearance
+{
+    size_t source; // index in the sources given to joinByUrl
+    size_t row;
+};
+
+//where one url was posted, ordered by submit time
+struct crossPost
+{
+    std::string_view url;
+    std::pmr::vector<appearance> appearances;
+};
+
+//"12h", "30d" or "2w"
+std::chrono::seconds parseHorizon(const std::string &horizon)
+{
+    size_t unit = 0;
+    auto value = std::stod(horizon, &unit);
+    auto suffix = horizon.substr(unit);
+    if (suffix == "h")
+        return std::chrono::seconds(static_cast<long long>(value * 60 * 60));
+    if (suffix.empty() || suffix == "d")
+        return std::chrono::seconds(static_cast<long long>(value * 24 * 60 * 60));
+    if (suffix == "w")
+        return std::chrono::seconds(static_cast<long long>(value * 7 * 24 * 60 * 60));
+    throw std::invalid_argument("Unknown horizon unit '" + suffix + "', use h, d or w");
+}
+
+//Every url found on at least two sources, ordered by url. All rows go
+//through one hash index in a single pass, so another source only adds its
+//own rows to the work.
+//Without a horizon every url is one cross-post and when a source has the
+//url more than once its first fetched row is used. With a horizon all
+//submissions are kept, the bucket of a url is sorted by time and cut into
+//cross-posts that each span at most the horizon from their first
+//submission, so an article resubmitted years later isn't a cross-post of
+//the original one. Resubmissions on one site within the horizon are part
+//of the same cross-post. The index and the cross-posts use the memory
+//resource of the first source, normally the run arena.
+std::pmr::vector<crossPost> joinByUrl(const std::vector<sourceTable> &sources, std::optional<std::chrono::seconds> horizon = std::nullopt)
+{
+    size_t rows = 0;
+    for (const auto &source : sources)
+        rows += source.posts.size();
+
+    std::pmr::memory_resource *resource = sources.empty() ? std::pmr::get_default_resource() : sources.front().posts.resource();
+    std::pmr::unordered_map<std::string_view, std::pmr::vector<appearance>> byUrl(resource);
+    byUrl.reserve(rows);
+    for (size_t source = 0; source < sources.size(); ++source)
+    {
+        const PostTable &posts = sources[source].posts;
+        for (size_t row = 0; row < posts.size(); ++row)
+        {
+            auto &appearances = byUrl[posts.original_url(row)];
+            if (horizon || appearances.empty() || appearances.back().source != source)
+                appearances.push_back({source, row});
+        }
+    }
+
+    auto submitted = [&sources](const appearance &at) { return sources[at.source].posts.submit_timestamp(at.row); };
+    std::pmr::vector<crossPost> joined(resource);
+    auto keep = [&joined](std::string_view url, std::pmr::vector<appearance> appearances) {
+        bool severalSources = std::any_of(appearances.begin(), appearances.end(), [&appearances](const appearance &at) {
+            return at.source != appearances.front().source;
+        });
+        if (severalSources)
+            joined.push_back({url, std::move(appearances)});
+    };
+    for (auto &[url, appearances] : byUrl)
+    {
+        if (appearances.size() < 2)
+            continue;
+        // on the same second the source given first counts as first
+        std::stable_sort(appearances.begin(), appearances.end(), [&submitted](const appearance &lhs, const appearance &rhs) {
+            return submitted(lhs) < submitted(rhs);
+        });
+        if (!horizon)
+        {
+            keep(url, std::move(appearances));
+            continue;
+        }
+
+        auto window = appearances.begin();
+        for (auto at = appearances.begin(); at != appearances.end(); ++at)
+        {
+            if (std::chrono::seconds(submitted(*at) - submitted(*window)) <= *horizon)
+                continue;
+            keep(url, {window, at, resource});
+            window = at;
+        }
+        keep(url, {window, appearances.end(), resource});
+    }
+    std::stable_sort(joined.begin(), joined.end(), [](const crossPost &lhs, const crossPost &rhs) { return lhs.url < rhs.url; });
+    return joined;
+}
+
+//Joins posts by url while they arrive. Every source has a hash index of
+//its posts by url, a new post probes the indexes of the other sources and
+//a new match is reported right away. The totals for the summary are kept
+//running: a match contributes to them and when one of its posts is fed
+//again, only the difference is applied. Safe to feed from several threads.
+class incrementalJoin
+{
+public:
+    struct matchRecord
+    {
+        std::string_view title;
+        std::string_view url;
+        size_t firstSource;
+        size_t laterSource;
+        time_t after; // seconds between the two submissions
+    };
+
+    explicit incrementalJoin(std::vector<std::string_view> names, std::function<void(const matchRecord &)> onMatch) :
+        _names(std::move(names)), _onMatch(std::move(onMatch)), _indexes(_names.size()), _totals(_names.size()) {};
+
+    void add(size_t source, const Post &post)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::string url(post.original_url);
+        auto [indexed, inserted] = _indexes[source].try_emplace(url);
+        snapshot &current = indexed->second;
+        if (!inserted && (current.id != std::string_view(post.id) || current.sameAs(post)))
+            return; // a second post with this url, or nothing changed
+        current = snapshot(post);
+
+        auto &counted = _matched[url];
+        auto before = counted;
+        counted = contributionOf(url);
+        _totals.apply(before, -1);
+        _totals.apply(counted, +1);
+
+        if (counted.sources >= 2 && counted.sources > before.sources)
+        {
+            size_t first = counted.firstSource;
+            size_t later = source != first ? source : counted.secondSource;
+            const snapshot &firstPost = _indexes[first].at(url);
+            const snapshot &laterPost = _indexes[later].at(url);
+            _onMatch({laterPost.title, indexed->first, first, later, laterPost.submitted - firstPost.submitted});
+        }
+    }
+
+    void printSummary() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::cout << _totals.matches << " matches. ";
+        for (size_t source = 0; source < _names.size(); ++source)
+        {
+            if (source > 0)
+                std::cout << (source + 1 == _names.size() ? " and " : ", ");
+            std::cout << _totals.firstOn[source] << " posts appeared first on " << _names[source];
+        }
+        std::cout << ".\n";
+        if (_totals.matches == 0)
+            return;
+
+        time_t avg = _totals.timeDiff / _totals.matches;
+        std::cout << "Average time for a cross-post: ";
+        printTm(gmtime(&avg));
+        std::cout << ".\n";
+
+        // in the order of analyze(), the last source first
+        auto printAverages = [this](const std::string &what, const std::vector<long> &sums) {
+            std::cout << "Average " << what << " on ";
+            for (size_t source = _names.size(); source-- > 0;)
+                std::cout << (source + 1 < _names.size() ? ", " : "") << _names[source] << ": " << (_totals.posts[source] ? static_cast<double>(sums[source]) / _totals.posts[source] : 0);
+            std::cout << ".\n";
+        };
+        std::cout << std::fixed << std::setprecision(1);
+        printAverages("comments", _totals.comments);
+        printAverages("score", _totals.votes);
+        std::cout << std::defaultfloat << std::setprecision(6);
+    }
+
+private:
+    struct snapshot
+    {
+        snapshot() = default;
+        explicit snapshot(const Post &post) :
+            id(post.id), title(post.title), submitted(post.submit_timestamp), votes(post.votes), comments(post.comment_count) {};
+
+        [[nodiscard]] bool sameAs(const Post &post) const
+        {
+            return submitted == post.submit_timestamp && votes == post.votes && comments == post.comment_count && title == std::string_view(post.title);
+        }
+
+        std::string id;
+        std::string title;
+        time_t submitted {0};
+        int votes {0};
+        int comments {0};
+    };
+
+    //what one url adds to the totals, nothing until it is on two sources
+    struct contribution
+    {
+        struct numbers
+        {
+            bool present {false};
+            int votes {0};
+            int comments {0};
+        };
+
+        size_t sources {0};
+        size_t firstSource {0};
+        size_t secondSource {0};
+        time_t timeDiff {0};
+        std::vector<numbers> perSource;
+    };
+
+    struct totals
+    {
+        explicit totals(size_t sources) :
+            firstOn(sources), posts(sources), votes(sources), comments(sources) {};
+
+        void apply(const contribution &url, int sign)
+        {
+            if (url.sources < 2)
+                return;
+            matches += sign;
+            firstOn[url.firstSource] += sign;
+            timeDiff += sign * url.timeDiff;
+            for (size_t source = 0; source < url.perSource.size(); ++source)
+            {
+                if (!url.perSource[source].present)
+                    continue;
+                posts[source] += sign;
+                votes[source] += sign * url.perSource[source].votes;
+                comments[source] += sign * url.perSource[source].comments;
+            }
+        }
+
+        long matches {0};
+        std::vector<long> firstOn;
+        time_t timeDiff {0};
+        std::vector<long> posts;
+        std::vector<long> votes;
+        std::vector<long> comments;
+    };
+
+    //probes every index, on the same second the source given first counts as first
+    [[nodiscard]] contribution contributionOf(const std::string &url) const
+    {
+        contribution result;
+        result.perSource.resize(_indexes.size());
+        std::optional<time_t> first;
+        std::optional<time_t> second;
+        for (size_t source = 0; source < _indexes.size(); ++source)
+        {
+            auto found = _indexes[source].find(url);
+            if (found == _indexes[source].end())
+                continue;
+            ++result.sources;
+            result.perSource[source] = {true, found->second.votes, found->second.comments};
+            time_t submitted = found->second.submitted;
+            if (!first || submitted < *first)
+            {
+                second = first;
+                result.secondSource = result.firstSource;
+                first = submitted;
+                result.firstSource = source;
+            }
+            else if (!second || submitted < *second)
+            {
+                second = submitted;
+                result.secondSource = source;
+            }
+        }
+        if (second)
+            result.timeDiff = *second - *first;
+        return result;
+    }
+
+    mutable std::mutex _mutex;
+    std::vector<std::string_view> _names;
+    std::function<void(const matchRecord &)> _onMatch;
+    std::vector<std::unordered_map<std::string, snapshot>> _indexes;
+    std::unordered_map<std::string, contribution> _matched;
+    totals _totals;
+};
+
+//Near duplicate titles with MinHash and locality sensitive hashing. A
+//title becomes the set of its lowercase words (numbers kept, short and
+//very common words left out), its signature holds the minimum hash of that set under
+//64 hash functions, cut into 16 bands of 4. Titles sharing a band are
+//candidates, about 99% of the pairs with a Jaccard similarity of 0.7 and
+//10% of those at 0.3 share one. Only candidates are compared, so
+//matching stays near linear in the number of posts.
+class titleIndex
+{
+public:
+    static constexpr size_t bands = 16;
+    static constexpr size_t rowsPerBand = 4;
+    static constexpr size_t minWords = 3;
+    using signature = std::array<uint64_t, bands * rowsPerBand>;
+
+    explicit titleIndex(const PostTable &table) :
+        _words(table.size())
+    {
+        for (size_t row = 0; row < table.size(); ++row)
+        {
+            _words[row] = words(table.title(row));
+            if (_words[row].size() < minWords)
+                continue;
+            auto hashes = minHash(_words[row]);
+            for (size_t band = 0; band < bands; ++band)
+                _buckets[band][bandKey(hashes, band)].push_back(row);
+        }
+    }
+
+    //rows sharing at least one band with these words, each once
+    [[nodiscard]] std::vector<size_t> candidates(const std::vector<uint64_t> &titleWords) const
+    {
+        std::vector<size_t> rows;
+        if (titleWords.size() < minWords)
+            return rows;
+        auto hashes = minHash(titleWords);
+        for (size_t band = 0; band < bands; ++band)
+        {
+            if (auto bucket = _buckets[band].find(bandKey(hashes, band)); bucket != _buckets[band].end())
+                rows.insert(rows.end(), bucket->second.begin(), bucket->second.end());
+        }
+        std::sort(rows.begin(), rows.end());
+        rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+        return rows;
+    }
+
+    [[nodiscard]] const std::vector<uint64_t> &wordsOf(size_t row) const { return _words[row]; }
+
+    //sorted, unique hashes of the words in the title
+    static std::vector<uint64_t> words(std::string_view title)
+    {
+        static const std::unordered_set<std::string_view> common {"the", "and", "for", "with", "from", "how", "why", "what", "you", "your", "are", "this", "that"};
+        std::vector<uint64_t> hashes;
+        std::string word;
+        for (size_t i = 0; i <= title.size(); ++i)
+        {
+            if (i < title.size() && std::isalnum(static_cast<unsigned char>(title[i])))
+            {
+                word += static_cast<char>(std::tolower(static_cast<unsigned char>(title[i])));
+                continue;
+            }
+            // numbers are kept whatever their length, "part 2" isn't "part 3"
+            bool number = std::any_of(word.begin(), word.end(), ::isdigit);
+            if ((number || word.size() >= 3) && !common.contains(word))
+                hashes.push_back(std::hash<std::string> {}(word));
+            word.clear();
+        }
+        std::sort(hashes.begin(), hashes.end());
+        hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+        return hashes;
+    }
+
+    //both sorted and unique
+    static double jaccard(const std::vector<uint64_t> &lhs, const std::vector<uint64_t> &rhs)
+    {
+        size_t shared = 0;
+        for (auto l = lhs.begin(), r = rhs.begin(); l != lhs.end() && r != rhs.end();)
+        {
+            if (*l < *r)
+                ++l;
+            else if (*r < *l)
+                ++r;
+            else
+            {
+                ++shared;
+                ++l;
+                ++r;
+            }
+        }
+        size_t all = lhs.size() + rhs.size() - shared;
+        return all ? static_cast<double>(shared) / all : 0;
+    }
+
+private:
+    //splitmix64, a cheap way to get independent looking hash functions
+    static uint64_t mix(uint64_t x)
+    {
+        x += 0x9e3779b97f4a7c15;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+        return x ^ (x >> 31);
+    }
+
+    static signature minHash(const std::vector<uint64_t> &titleWords)
+    {
+        signature hashes;
+        hashes.fill(std::numeric_limits<uint64_t>::max());
+        for (auto word : titleWords)
+        {
+            for (size_t i = 0; i < hashes.size(); ++i)
+                hashes[i] = std::min(hashes[i], mix(word ^ mix(i)));
+        }
+        return hashes;
+    }
+
+    static uint64_t bandKey(const signature &hashes, size_t band)
+    {
+        uint64_t key = 0;
+        for (size_t i = band * rowsPerBand; i < (band + 1) * rowsPerBand; ++i)
+            key = mix(key ^ hashes[i]);
+        return key;
+    }
+
+    std::vector<std::vector<uint64_t>> _words;
+    std::array<std::unordered_map<uint64_t, std::vector<size_t>>, bands> _buckets;
+};
+
+//Posts with (nearly) the same title but a different url, like a mirror or
+//an archive link. Urls that already matched are left out, every post is
+//used in at most one match, the most similar pairs go first. With a
+//horizon, as in joinByUrl, only posts submitted within it are paired.
+std::pmr::vector<postMatch> matchByTitle(const PostTable &firstPosts, const PostTable &secondPosts, const std::unordered_set<std::string_view> &matchedUrls,
+                                         std::optional<std::chrono::seconds> horizon = std::nullopt, double threshold = 0.7)
+{
+    titleIndex secondTitles(secondPosts);
+    struct scoredMatch
+    {
+        double similarity;
+        postMatch rows;
+    };
+    std::vector<scoredMatch> scored;
+    for (size_t firstRow = 0; firstRow < firstPosts.size(); ++firstRow)
+    {
+        if (matchedUrls.contains(firstPosts.original_url(firstRow)))
+            continue;
+        auto words = titleIndex::words(firstPosts.title(firstRow));
+        for (auto secondRow : secondTitles.candidates(words))
+        {
+            if (matchedUrls.contains(secondPosts.original_url(secondRow)))
+                continue;
+            if (horizon && std::chrono::seconds(std::abs(secondPosts.submit_timestamp(secondRow) - firstPosts.submit_timestamp(firstRow))) > *horizon)
+                continue;
+            double similarity = titleIndex::jaccard(words, secondTitles.wordsOf(secondRow));
+            if (similarity >= threshold)
+                scored.push_back({similarity, {firstRow, secondRow}});
+        }
+    }
+    std::stable_sort(scored.begin(), scored.end(), [](const scoredMatch &lhs, const scoredMatch &rhs) { return lhs.similarity > rhs.similarity; });
+
+    std::pmr::vector<postMatch> matches(firstPosts.resource());
+    std::unordered_set<size_t> usedFirst;
+    std::unordered_set<size_t> usedSecond;
+    for (const auto &match : scored)
+    {
+        if (usedFirst.contains(match.rows.firstRow) || usedSecond.contains(match.rows.secondRow))
+            continue;
+        usedFirst.insert(match.rows.firstRow);
+        usedSecond.insert(match.rows.secondRow);
+        matches.push_back(match.rows);
+    }
+    return matches;
+}
+
+//Space-Saving: the most frequent keys of a stream in a fixed number of
+//counters. A new key takes over the counter with the lowest count when all
+//are in use and inherits that count as its possible overcount (error), so
+//every key with a true count above total / capacity is kept. Two summaries
+//merge into one with the same guarantee (Agarwal et al.).
+class spaceSaving
+{
+public:
+    struct counter
+    {
+        std::string key;
+        uint64_t count {0};
+        uint64_t error {0};
+    };
+
+    explicit spaceSaving(size_t capacity = 1024) :
+        _capacity(capacity) {};
+
+    void add(std::string_view key, uint64_t count = 1)
+    {
+        if (auto found = _counters.find(key); found != _counters.end())
+        {
+            found->second.count += count;
+            return;
+        }
+        if (_counters.size() < _capacity)
+        {
+            _counters.emplace(std::string(key), counter {std::string(key), count, 0});
+            return;
+        }
+        // linear, but only for keys that are not counted yet once all counters are taken
+        auto lowest = std::min_element(_counters.begin(), _counters.end(), [](const auto &a, const auto &b) { return a.second.count < b.second.count; });
+        counter replacement {std::string(key), lowest->second.count + count, lowest->second.count};
+        _counters.erase(lowest);
+        _counters.emplace(replacement.key, std::move(replacement));
+    }
+
+    void merge(const spaceSaving &other)
+    {
+        // a key missing from a full summary may have been counted up to its lowest count
+        uint64_t ownFloor = _counters.size() < _capacity ? 0 : lowestCount();
+        uint64_t otherFloor = other._counters.size() < other._capacity ? 0 : other.lowestCount();
+        std::unordered_map<std::string, counter, keyHash, std::equal_to<>> merged;
+        for (const auto &[key, own] : _counters)
+        {
+            auto theirs = other._counters.find(key);
+            merged.emplace(key, theirs == other._counters.end() ? counter {key, own.count + otherFloor, own.error + otherFloor}
+                                                                : counter {key, own.count + theirs->second.count, own.error + theirs->second.error});
+        }
+        for (const auto &[key, theirs] : other._counters)
+        {
+            if (!_counters.contains(key))
+                merged.emplace(key, counter {key, theirs.count + ownFloor, theirs.error + ownFloor});
+        }
+
+        auto all = sorted(merged);
+        if (all.size() > _capacity)
+            all.resize(_capacity);
+        _counters.clear();
+        for (auto &kept : all)
+            _counters.emplace(kept.key, std::move(kept));
+    }
+
+    //the k keys with the highest counts, highest first
+    [[nodiscard]] std::vector<counter> top(size_t k) const
+    {
+        auto all = sorted(_counters);
+        if (all.size() > k)
+            all.resize(k);
+        return all;
+    }
+
+    void write(std::ostream &os) const
+    {
+        writeValue<uint64_t>(os, _capacity);
+        writeValue<uint64_t>(os, _counters.size());
+        for (const auto &[key, counted] : _counters)
+        {
+            writeString(os, key);
+            writeValue<uint64_t>(os, counted.count);
+            writeValue<uint64_t>(os, counted.error);
+        }
+    }
+
+    static spaceSaving read(std::istream &is)
+    {
+        spaceSaving summary(readValue<uint64_t>(is));
+        auto counters = readValue<uint64_t>(is);
+        for (uint64_t i = 0; i < counters && is; ++i)
+        {
+            counter counted {readString(is)};
+            counted.count = readValue<uint64_t>(is);
+            counted.error = readValue<uint64_t>(is);
+            summary._counters.emplace(counted.key, std::move(counted));
+        }
+        return summary;
+    }
+
+private:
+    struct keyHash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view key) const { return std::hash<std::string_view> {}(key); }
+    };
+
+    [[nodiscard]] uint64_t lowestCount() const
+    {
+        uint64_t lowest = std::numeric_limits<uint64_t>::max();
+        for (const auto &[key, counted] : _counters)
+            lowest = std::min(lowest, counted.count);
+        return _counters.empty() ? 0 : lowest;
+    }
+
+    template <typename Counters>
+    static std::vector<counter> sorted(const Counters &counters)
+    {
+        std::vector<counter> all;
+        all.reserve(counters.size());
+        for (const auto &[key, counted] : counters)
+            all.push_back(counted);
+        std::sort(all.begin(), all.end(), [](const counter &a, const counter &b) { return a.count != b.count ? a.count > b.count : a.key < b.key; });
+        return all;
+    }
+
+    size_t _capacity;
+    std::unordered_map<std::string, counter, keyHash, std::equal_to<>> _counters;
+};
+
+//Count-Min sketch: approximate counts of any number of keys in a fixed
+//table. An estimate is never below the true count and is above it by at
+//most 2 / width of the total with 1 - 2^-depth probability. Sketches of
+//the same size merge by adding the tables.
+class countMinSketch
+{
+public:
+    explicit countMinSketch(size_t width = 4096, size_t depth = 4) :
+        _width(width), _depth(depth), _table(width * depth) {};
+
+    void add(std::string_view key, uint32_t count = 1)
+    {
+        auto hash = stableHash(key);
+        for (size_t row = 0; row < _depth; ++row)
+            _table[slot(hash, row)] += count;
+    }
+
+    [[nodiscard]] uint32_t estimate(std::string_view key) const
+    {
+        auto hash = stableHash(key);
+        uint32_t estimate = std::numeric_limits<uint32_t>::max();
+        for (size_t row = 0; row < _depth; ++row)
+            estimate = std::min(estimate, _table[slot(hash, row)]);
+        return estimate;
+    }
+
+    void merge(const countMinSketch &other)
+    {
+        if (other._width != _width || other._depth != _depth)
+            throw std::invalid_argument("Cannot merge count-min sketches of different sizes");
+        for (size_t i = 0; i < _table.size(); ++i)
+            _table[i] += other._table[i];
+    }
+
+    void write(std::ostream &os) const
+    {
+        writeValue<uint64_t>(os, _width);
+        writeValue<uint64_t>(os, _depth);
+        os.write(reinterpret_cast<const char *>(_table.data()), _table.size() * sizeof(uint32_t));
+    }
+
+    static countMinSketch read(std::istream &is)
+    {
+        auto width = readValue<uint64_t>(is);
+        countMinSketch sketch(width, readValue<uint64_t>(is));
+        is.read(reinterpret_cast<char *>(sketch._table.data()), sketch._table.size() * sizeof(uint32_t));
+        return sketch;
+    }
+
+private:
+    //row i uses h1 + i * h2 (Kirsch and Mitzenmacher), from one stable hash
+    [[nodiscard]] size_t slot(uint64_t hash, size_t row) const
+    {
+        uint64_t h1 = hash & 0xffffffff;
+        uint64_t h2 = (hash >> 32) | 1;
+        return row * _width + (h1 + row * h2) % _width;
+    }
+
+    size_t _width;
+    size_t _depth;
+    std::vector<uint32_t> _table;
+};
+
+//"https://www.example.com:8080/a" to "example.com", empty for a post without url
+std::string_view urlDomain(std::string_view url)
+{
+    if (auto scheme = url.find("://"); scheme != std::string_view::npos)
+        url.remove_prefix(scheme + 3);
+    url = url.substr(0, url.find_first_of("/:?#"));
+    if (url.starts_with("www."))
+        url.remove_prefix(4);
+    return url;
+}
+
+//The keys (domains or submitters) that cross-post most. The cross-posts per
+//key are a Space-Saving summary, the posts per key and how often a key was
+//first on a site are Count-Min sketches. The memory is fixed, however long
+//the history, and the counts of several runs merge.
+class heavyHitters
+{
+public:
+    struct hitter
+    {
+        std::string key;
+        uint64_t crossPosts;
+        uint64_t error;
+        uint32_t posts;
+        std::vector<std::pair<std::string, uint32_t>> firstOn; // per site
+    };
+
+    void addPost(std::string_view key) { _posts.add(key); }
+
+    void addCrossPost(std::string_view key, std::string_view firstSite)
+    {
+        _crossPosts.add(key);
+        _firstOn.add(firstKey(key, firstSite));
+        if (std::find(_sites.begin(), _sites.end(), firstSite) == _sites.end())
+            _sites.emplace_back(firstSite);
+    }
+
+    void merge(const heavyHitters &other)
+    {
+        _crossPosts.merge(other._crossPosts);
+        _posts.merge(other._posts);
+        _firstOn.merge(other._firstOn);
+        for (const auto &site : other._sites)
+        {
+            if (std::find(_sites.begin(), _sites.end(), site) == _sites.end())
+                _sites.push_back(site);
+        }
+    }
+
+    [[nodiscard]] std::vector<hitter> top(size_t k) const
+    {
+        std::vector<hitter> hitters;
+        for (auto &counted : _crossPosts.top(k))
+        {
+            hitter &top = hitters.emplace_back(hitter {std::move(counted.key), counted.count, counted.error, 0, {}});
+            top.posts = _posts.estimate(top.key);
+            for (const auto &site : _sites)
+                top.firstOn.emplace_back(site, _firstOn.estimate(firstKey(top.key, site)));
+        }
+        return hitters;
+    }
+
+    //the k keys most often first on site, by their share of cross-posts. Only
+    //keys with at least minimum guaranteed cross-posts take part, so a single
+    //cross-post does not rank as 100%.
+    [[nodiscard]] std::vector<hitter> topFirstOn(std::string_view site, size_t k, uint64_t minimum) const
+    {
+        auto share = [&site](const hitter &top) {
+            auto first = std::find_if(top.firstOn.begin(), top.firstOn.end(), [&site](const auto &counted) { return counted.first == site; });
+            return first == top.firstOn.end() ? 0.0 : std::min(1.0, static_cast<double>(first->second) / static_cast<double>(top.crossPosts));
+        };
+        auto hitters = top(std::numeric_limits<size_t>::max());
+        std::erase_if(hitters, [minimum](const hitter &top) { return top.crossPosts - top.error < minimum; });
+        std::stable_sort(hitters.begin(), hitters.end(), [&share](const hitter &a, const hitter &b) { return share(a) > share(b); });
+        if (hitters.size() > k)
+            hitters.resize(k);
+        return hitters;
+    }
+
+    [[nodiscard]] const std::vector<std::string> &sites() const { return _sites; }
+
+    void write(std::ostream &os) const
+    {
+        _crossPosts.write(os);
+        _posts.write(os);
+        _firstOn.write(os);
+        writeValue<uint32_t>(os, _sites.size());
+        for (const auto &site : _sites)
+            writeString(os, site);
+    }
+
+    static heavyHitters read(std::istream &is)
+    {
+        heavyHitters hitters;
+        hitters._crossPosts = spaceSaving::read(is);
+        hitters._posts = countMinSketch::read(is);
+        hitters._firstOn = countMinSketch::read(is);
+        auto sites = readValue<uint32_t>(is);
+        for (uint32_t i = 0; i < sites && is; ++i)
+            hitters._sites.push_back(readString(is));
+        return hitters;
+    }
+
+private:
+    static std::string firstKey(std::string_view key, std::string_view site)
+    {
+        std::string first(site);
+        first += '\0';
+        first += key;
+        return first;
+    }
+
+    spaceSaving _crossPosts;
+    countMinSketch _posts;
+    countMinSketch _firstOn;
+    std::vector<std::string> _sites;
+};
+
+//Heavy hitters by domain and by submitter ("HN user"), fed by every fetched
+//post and every match. With --history they are kept in dir/hitters.dat and
+//merged with every run, so the top lists cover the whole history.
+class crossPostHitters
+{
+public:
+    void start(const std::string &dir)
+    {
+        _file = std::filesystem::path(dir) / "hitters.dat";
+        _enabled = true;
+        std::ifstream saved(_file, std::ios::binary);
+        if (!saved)
+            return;
+        _history.domains = heavyHitters::read(saved);
+        _history.submitters = heavyHitters::read(saved);
+        if (!saved)
+            throw std::runtime_error("Corrupt heavy hitters file '" + _file.string() + "'");
+    }
+
+    //print the top k after the run, see finish()
+    void showTop(size_t k)
+    {
+        _topK = k;
+        _enabled = true;
+    }
+    [[nodiscard]] size_t topK() const { return _topK; }
+    [[nodiscard]] bool enabled() const { return _enabled; }
+
+    //the site is the first word of the section, HN lists count as HN. A post
+    //in several lists of a run is counted once.
+    void addPosts(const std::vector<postSection> &sections)
+    {
+        if (!_enabled)
+            return;
+        for (const auto &section : sections)
+        {
+            std::string_view site = std::string_view(section.source).substr(0, section.source.find(' '));
+            for (size_t row = 0; row < section.posts.size(); ++row)
+            {
+                if (!_countedPosts.insert(postKey(site, section.posts.id(row))).second)
+                    continue;
+                if (auto domain = urlDomain(section.posts.original_url(row)); !domain.empty())
+                    _run.domains.addPost(domain);
+                _run.submitters.addPost(submitterKey(site, section.posts.submitter(row)));
+            }
+        }
+    }
+
+    //as addPosts, a match found again with another list of the run is counted once
+    void addMatch(const std::vector<sourceTable> &sources, const crossPost &match)
+    {
+        if (!_enabled || match.appearances.empty())
+            return;
+        std::string matchKey;
+        for (const auto &at : match.appearances)
+            matchKey += postKey(sources[at.source].source.shortName(), sources[at.source].posts.id(at.row));
+        if (!_countedMatches.insert(std::move(matchKey)).second)
+            return;
+        auto firstSite = sources[match.appearances.front().source].source.shortName();
+        if (auto domain = urlDomain(match.url); !domain.empty())
+            _run.domains.addCrossPost(domain, firstSite);
+        for (const auto &at : match.appearances)
+        {
+            auto site = sources[at.source].source.shortName();
+            _run.submitters.addCrossPost(submitterKey(site, sources[at.source].posts.submitter(at.row)), firstSite);
+        }
+    }
+
+    void finish()
+    {
+        if (_topK > 0)
+            printTop(_topK);
+        save();
+    }
+
+    //merges this run into the history and saves it, replacing the file once
+    //completely written. A failed write keeps the previous file.
+    void save() noexcept
+    {
+        if (_file.empty())
+            return;
+        try
+        {
+            _history.domains.merge(_run.domains);
+            _history.submitters.merge(_run.submitters);
+            _run = {};
+            _countedPosts.clear();
+            _countedMatches.clear();
+            auto partial = _file;
+            partial += ".partial";
+            std::ofstream out(partial, std::ios::binary | std::ios::trunc);
+            _history.domains.write(out);
+            _history.submitters.write(out);
+            out.close();
+            std::error_code error;
+            if (!out)
+                error = std::make_error_code(std::errc::io_error);
+            else
+                std::filesystem::rename(partial, _file, error);
+            if (error)
+            {
+                std::filesystem::remove(partial, error);
+                std::cout << "Warning: cannot write the heavy hitters to '" << _file.string() << "'\n";
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::cout << "Warning: cannot write the heavy hitters to '" << _file.string() << "': " << e.what() << "\n";
+        }
+    }
+
+    //this run, merged with the history when there is one
+    void printTop(size_t k) const
+    {
+        auto all = _history;
+        all.domains.merge(_run.domains);
+        all.submitters.merge(_run.submitters);
+        print("Top domains by cross-posts", all.domains.top(k));
+        print("Top submitters by cross-posts", all.submitters.top(k));
+        for (const auto &[what, hitters] : {std::pair {"domains", &all.domains}, std::pair {"submitters", &all.submitters}})
+        {
+            for (const auto &site : hitters->sites())
+                print("Top " + std::string(what) + " by share first on " + site + " (at least " + std::to_string(minimumForShare) + " cross-posts)", hitters->topFirstOn(site, k, minimumForShare));
+        }
+    }
+
+private:
+    struct hitterSet
+    {
+        heavyHitters domains;
+        heavyHitters submitters;
+    };
+
+    static std::string postKey(std::string_view site, std::string_view id)
+    {
+        std::string key(site);
+        key += '\0';
+        key += id;
+        key += '\0';
+        return key;
+    }
+
+    static std::string submitterKey(std::string_view site, std::string_view submitter)
+    {
+        std::string key(site);
+        key += ' ';
+        key += submitter;
+        return key;
+    }
+
+    static constexpr uint64_t minimumForShare = 3;
+
+    static void print(const std::string &heading, const std::vector<heavyHitters::hitter> &hitters)
+    {
+        std::cout << heading << ":\n";
+        if (hitters.empty())
+            std::cout << "none yet.\n";
+        for (size_t i = 0; i < hitters.size(); ++i)
+        {
+            const auto &top = hitters[i];
+            std::cout << i + 1 << ". " << top.key << ": " << top.crossPosts;
+            if (top.error)
+                std::cout << " (at most " << top.error << " too many)";
+            std::cout << " cross-posts of " << top.posts << " posts, first on ";
+            for (size_t site = 0; site < top.firstOn.size(); ++site)
+                std::cout << (site ? ", " : "") << top.firstOn[site].first << " " << std::min<uint64_t>(100, (200 * top.firstOn[site].second + top.crossPosts) / std::max<uint64_t>(2 * top.crossPosts, 1)) << "%";
+            std::cout << ".\n";
+        }
+        std::cout << "\n";
+    }
+
+    bool _enabled {false};
+    size_t _topK {0};
+    std::filesystem::path _file;
+    hitterSet _history;
+    hitterSet _run;
+    std::unordered_set<std::string> _countedPosts;
+    std::unordered_set<std::string> _countedMatches;
+};
+
+crossPostHitters &Hitters()
+{
+    static crossPostHitters hitters;
+    return hitters;
+}
+
+struct analyzeOptions
+{
+    bool matchTitles {false};
+    std::optional<std::chrono::seconds> horizon; // see joinByUrl
+};
+
+void analyze(const std::vector<sourceTable> &sources, const analyzeOptions &options = {})
+{
+    static const size_t analyzeSeconds = Metrics().histogram("hn_lob_comp_analyze_seconds", "Time to match and report the posts.");
+    static const size_t matchesFound = Metrics().counter("hn_lob_comp_matches_total", "Posts found on more than one site.");
+    auto timer = Metrics().timer(analyzeSeconds);
+    size_t nameWidth = 0;
+    for (const auto &source : sources)
+        nameWidth = std::max(nameWidth, source.source.fullName().size());
+    for (const auto &source : sources)
+        std::cout << "Number of posts from " << std::left << std::setw(nameWidth + 1) << source.source.fullName() << std::right << ": " << source.posts.size() << "\n";
+    std::cout << "\n";
+
+    auto matches = joinByUrl(sources, options.horizon);
+    if (options.matchTitles)
+    {
+        // titles are compared between the first source and each other one
+        std::unordered_set<std::string_view> matchedUrls;
+        for (const auto &match : matches)
+            matchedUrls.insert(match.url);
+        size_t urlMatches = matches.size();
+        for (size_t other = 1; other < sources.size(); ++other)
+        {
+            for (const auto &match : matchByTitle(sources[0].posts, sources[other].posts, matchedUrls, options.horizon))
+            {
+                std::pmr::vector<appearance> appearances({{0, match.firstRow}, {other, match.secondRow}}, matches.get_allocator());
+                if (sources[other].posts.submit_timestamp(match.secondRow) < sources[0].posts.submit_timestamp(match.firstRow))
+                    std::swap(appearances[0], appearances[1]);
+                matches.push_back({sources[other].posts.original_url(match.secondRow), std::move(appearances)});
+            }
+        }
+        std::cout << "Matches (" << matches.size() << ", " << matches.size() - urlMatches << " by title):\n\n";
+    }
+    else
+    {
+        std::cout << "Matches (" << matches.size() << "):\n\n";
+    }
+
+    std::vector<size_t> firstOn(sources.size());
+    runningStats timeDiff;
+    std::vector<runningStats> scores(sources.size());
+    std::vector<runningStats> comments(sources.size());
+    // score on every other source relative to the first source
+    std::vector<runningStats> scoreRatios(sources.size());
+
+    for (const auto &match : matches)
+    {
+        Hitters().addMatch(sources, match);
+        auto name = [&sources](const appearance &at) { return sources[at.source].source.name(); };
+        auto posts = [&sources](const appearance &at) -> const PostTable & { return sources[at.source].posts; };
+
+        // the title as the last of the sources has it
+        auto titled = std::max_element(match.appearances.begin(), match.appearances.end(), [](const appearance &lhs, const appearance &rhs) { return lhs.source < rhs.source; });
+        std::cout << "# " << posts(*titled).title(titled->row) << "  \nURL: " << match.url << "  \n";
+        for (const auto &at : match.appearances)
+        {
+            if (posts(at).original_url(at.row) != match.url)
+                std::cout << name(at) << " title: " << posts(at).title(at.row) << "  \n" << name(at) << " URL: " << posts(at).original_url(at.row) << "  \n";
+        }
+
+        for (const auto &at : match.appearances)
+        {
+            scores[at.source].add(posts(at).votes(at.row));
+            comments[at.source].add(posts(at).comment_count(at.row));
+        }
+        auto onFirstSource = std::find_if(match.appearances.begin(), match.appearances.end(), [](const appearance &at) { return at.source == 0; });
+        if (onFirstSource != match.appearances.end() && posts(*onFirstSource).votes(onFirstSource->row) > 0)
+        {
+            std::vector<bool> counted(sources.size());
+            for (const auto &at : match.appearances)
+            {
+                if (at.source == 0 || counted[at.source])
+                    continue;
+                counted[at.source] = true;
+                scoreRatios[at.source].add(static_cast<double>(posts(at).votes(at.row)) / posts(*onFirstSource).votes(onFirstSource->row));
+            }
+        }
+
+        const appearance &first = match.appearances.front();
+        ++firstOn[first.source];
+        std::cout << "First appeared on **" << name(first) << "** with " << posts(first).votes(first.row)
+                  << " votes and " << posts(first).comment_count(first.row) << " comments, submitted by "
+                  << posts(first).submitter(first.row) << " (" << Post::printDateTimeLocal(posts(first).submit_timestamp(first.row)) << "; "
+                  << posts(first).comment_url(first.row) << " ).  \n";
+
+        bool crossPosted = false;
+        for (auto later = std::next(match.appearances.begin()); later != match.appearances.end(); ++later)
+        {
+            time_t diffSec = difftime(posts(*later).submit_timestamp(later->row), posts(first).submit_timestamp(first.row));
+            if (!crossPosted && later->source != first.source)
+            {
+                timeDiff.add(diffSec);
+                crossPosted = true;
+            }
+
+            if (std::chrono::seconds(diffSec) < std::chrono::hours(1))
+                std::cout << "**Within the hour this was also posted to " << name(*later) << "!**\n";
+
+            tm *tp = gmtime(&diffSec); // utc
+            std::cout << "After ";
+            printTm(tp);
+
+            std::cout << "it was submitted to **" << name(*later) << "** by " << posts(*later).submitter(later->row) << " with "
+                      << posts(*later).votes(later->row) << " votes and " << posts(*later).comment_count(later->row) << " comments ("
+                      << Post::printDateTimeLocal(posts(*later).submit_timestamp(later->row)) << "; " << posts(*later).comment_url(later->row) << " ).  \n";
+        }
+
+        // on a tie the later submission wins
+        const appearance *highestScore = &first;
+        const appearance *mostComments = &first;
+        int votesTotal = 0;
+        int commentsTotal = 0;
+        for (const auto &at : match.appearances)
+        {
+            if (posts(at).votes(at.row) >= posts(*highestScore).votes(highestScore->row))
+                highestScore = &at;
+            if (posts(at).comment_count(at.row) >= posts(*mostComments).comment_count(mostComments->row))
+                mostComments = &at;
+            votesTotal += posts(at).votes(at.row);
+            commentsTotal += posts(at).comment_count(at.row);
+        }
+        std::cout << "The highest score was reached on " << (votesTotal <= 0 ? "nowhere" : name(*highestScore))
+                  << " and the most comments were on " << (commentsTotal <= 0 ? "nowhere" : name(*mostComments)) << ".  \n";
+
+        bool sameSubmitter = std::all_of(match.appearances.begin(), match.appearances.end(), [&](const appearance &at) {
+            return posts(at).submitter(at.row) == posts(first).submitter(first.row);
+        });
+        if (sameSubmitter)
+            std::cout << "**The same username submitted the post to " << (match.appearances.size() == 2 ? "both" : "all these") << " sites**.  \n";
+
+        std::cout << "\n";
+    }
+
+    for (size_t source = 0; source < sources.size(); ++source)
+    {
+        if (source > 0)
+            std::cout << (source + 1 == sources.size() ? " and " : ", ");
+        std::cout << firstOn[source] << " posts appeared first on " << sources[source].source.name();
+    }
+    std::cout << ".\n";
+    Metrics().add(matchesFound, matches.size());
+    for (size_t source = 0; source < sources.size(); ++source)
+        Metrics().add(sources[source].source.metrics().firstOn, firstOn[source]);
+    // partial data can easily have no matches at all
+    if (matches.empty())
+        return;
+
+    auto avg = static_cast<time_t>(timeDiff.mean());
+
+    tm *diff_tp = gmtime(&avg);
+    std::cout << "Average time for a cross-post: ";
+    printTm(diff_tp);
+    std::cout << ".\n";
+
+    auto hours = [](double seconds) { return seconds / 3600; };
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Time for a cross-post in hours, p50: " << hours(timeDiff.percentile(0.5)) << ", p90: " << hours(timeDiff.percentile(0.9))
+              << ", p99: " << hours(timeDiff.percentile(0.99)) << ", min: " << hours(timeDiff.min()) << ", max: " << hours(timeDiff.max())
+              << ", standard deviation: " << hours(std::sqrt(timeDiff.variance())) << ".\n";
+
+    // the last source first, HN before Lobsters as this line always had it
+    auto printAverages = [&sources](const std::string &what, const std::vector<runningStats> &values) {
+        std::cout << "Average " << what << " on ";
+        bool separator = false;
+        for (size_t source = sources.size(); source-- > 0;)
+        {
+            if (values[source].count() == 0)
+                continue;
+            std::cout << (separator ? ", " : "") << sources[source].source.shortName() << ": " << values[source].mean();
+            separator = true;
+        }
+        std::cout << ".\n";
+    };
+    printAverages("comments", comments);
+    printAverages("score", scores);
+
+    for (size_t source = 1; source < sources.size(); ++source)
+    {
+        const runningStats &ratio = scoreRatios[source];
+        if (ratio.count() == 0)
+            continue;
+        std::cout << "Score on " << sources[source].source.shortName() << " relative to " << sources[0].source.shortName()
+                  << ", p50: " << ratio.percentile(0.5) << "x, p90: " << ratio.percentile(0.9) << "x, p99: " << ratio.percentile(0.99) << "x.\n";
+    }
+    std::cout << std::defaultfloat << std::setprecision(6);
+}
+
+//only says something when a source is missing data
+void printCompleteness(const aggregator &lobster, const aggregator &hn)
+{
+    if (!hn.report().complete())
+        std::cout << "Incomplete data from Hacker News: " << hn.report() << "\n\n";
+    if (!lobster.report().complete())
+        std::cout << "Incomplete data from Lobsters: " << lobster.report() << "\n\n";
+    if (auto retried = Retries().retried())
+        std::cout << "Retried " << retried << " requests after transient errors.\n\n";
+}
+
+std::vector<std::string> &Arguments()
+{
+    static std::vector<std::string> arguments;
+    return arguments;
+}
+
+//true if "--name" was given
+bool argumentFlag(const std::string &name)
+{
+    return std::find(Arguments().cbegin(), Arguments().cend(), "--" + name) != Arguments().cend();
+}
+
+//value of a "--name=value" argument, empty if it was not given
+std::string argumentValue(const std::string &name)
+{
+    const std::string prefix = "--" + name + "=";
+    for (const auto &argument : Arguments())
+    {
+        if (argument.rfind(prefix, 0) == 0)
+            return argument.substr(prefix.size());
+    }
+    return {};
+}
+
+void usage()
+{
+    std::cout << "Usage: " << Arguments().at(0) << " [help|test|top|new|track|history] [--record=dir|--replay=dir] [--hedge] [--budget=5s] [--rate=N] [--adaptive-depth] [--hn-depth=200] [--hn-lists=best,new,show] [--match-titles] [--stream] [--horizon=30d] [--history=dir] [--interval=5m] [--rounds=12] [--top-k=10] [--metrics=file]\n";
+    std::cout << Arguments().at(0) << " top: analyze top stories from HN & Lobsters.\n";
+    std::cout << Arguments().at(0) << " help: this text.\n";
+    std::cout << Arguments().at(0) << " test: run a test to check your timezones.\n";
+    std::cout << Arguments().at(0) << " new: get new posts instead of best.\n";
+    std::cout << Arguments().at(0) << " track: follow the votes and comments of the matched top stories over time.\n";
+    std::cout << Arguments().at(0) << " history: count the cross-posts in the --history folder, read in place from its column files, and the top domains and submitters.\n";
+    std::cout << "--record=dir: save every upstream response in dir for later replay.\n";
+    std::cout << "--replay=dir: use the responses saved in dir instead of the network.\n";
+    std::cout << "--hedge: send a second request when one is slower than the p95 so far.\n";
+    std::cout << "--budget=5s: stop fetching after this time (ms, s, m) and analyze what arrived, for every round of track.\n";
+    std::cout << "--rate=N: send at most N requests per second to each site.\n";
+    std::cout << "--adaptive-depth: fetch as many Lobsters pages as the time span of the HN posts needs.\n";
+    std::cout << "--hn-depth=200: number of stories to fetch from the HN list (it has up to 500).\n";
+    std::cout << "--hn-lists=best,new,show: compare against each of these HN lists (top, best, new, show, ask, job), shared stories are fetched once. A list can have its own depth, e.g. best:60,top:30, the others use --hn-depth.\n";
+    std::cout << "--match-titles: also match posts with nearly the same title but a different URL.\n";
+    std::cout << "--stream: print every match by url as soon as both posts arrived, then a summary (not with --match-titles, --horizon, --adaptive-depth or --hn-lists).\n";
+    std::cout << "--horizon=30d: only pair submissions of a URL, or of a title with --match-titles, within this time (h, d, w), keeping resubmissions.\n";
+    std::cout << "--history=dir: append the votes and comments of every fetched post to the history in this folder.\n";
+    std::cout << "--interval=5m: time between the fetches of the track command (ms, s, m).\n";
+    std::cout << "--rounds=12: number of times the track command fetches the matched posts again.\n";
+    std::cout << "--top-k=10: list the domains and submitters with the most cross-posts and with the highest share first on each site, over the whole history with --history.\n";
+    std::cout << "--metrics=file: write Prometheus metrics of the run to this file, e.g. for the node_exporter textfile collector.\n";
+}
+
+//"a,b,c" to {"a", "b", "c"}
+std::vector<std::string> splitList(const std::string &value)
+{
+    std::vector<std::string> items;
+    std::stringstream stream(value);
+    for (std::string item; std::getline(stream, item, ',');)
+    {
+        if (!item.empty())
+            items.push_back(item);
+    }
+    return items;
+}
+
+//the --hn-lists value, every name one of the story lists of the HN api,
+//optionally followed by its own depth (best:60), otherwise --hn-depth
+std::vector<hackernews::listRequest> parseHnLists(const std::string &value, size_t defaultDepth)
+{
+    static const std::array<std::string_view, 6> known {"top", "best", "new", "show", "ask", "job"};
+    std::vector<hackernews::listRequest> requests;
+    for (const auto &item : splitList(value))
+    {
+        auto separator = item.find(':');
+        hackernews::listRequest request {item.substr(0, separator), defaultDepth};
+        if (std::find(known.begin(), known.end(), request.name) == known.end())
+            throw std::invalid_argument("Unknown HN list '" + request.name + "', use top, best, new, show, ask or job");
+        if (std::any_of(requests.begin(), requests.end(), [&request](const auto &other) { return other.name == request.name; }))
+            throw std::invalid_argument("HN list '" + request.name + "' is given twice");
+        if (separator != std::string::npos)
+        {
+            auto depth = std::string_view(item).substr(separator + 1);
+            auto [rest, error] = std::from_chars(depth.data(), depth.data() + depth.size(), request.depth);
+            if (error != std::errc() || rest != depth.data() + depth.size() || request.depth == 0)
+                throw std::invalid_argument("Invalid depth '" + std::string(depth) + "' for HN list '" + request.name + "', use a positive number of stories");
+        }
+        requests.push_back(std::move(request));
+    }
+    if (requests.empty())
+        throw std::invalid_argument("No HN list in '" + value + "', use top, best, new, show, ask or job");
+    return requests;
+}
+
+//Fetches both sources at the same time and prints every match as soon as
+//its second post arrived, followed by the running totals.
+int streamSources(lobsters &lobster, hackernews &hn, runArena &arena)
+{
+    std::cout << "Streaming matches between Lobsters and HackerNews as the posts arrive\n\n";
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::string_view> names {lobster.shortName(), hn.shortName()};
+    incrementalJoin join(names, [&names, start](const incrementalJoin::matchRecord &match) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        std::cout << "[" << std::setw(5) << elapsed.count() << " ms] " << match.title << " (" << match.url << "), first on "
+                  << names[match.firstSource] << ", after ";
+        tm *tp = gmtime(&match.after);
+        printTm(tp);
+        std::cout << "on " << names[match.laterSource] << ".\n";
+    });
+    lobster.onPosts([&join](const std::pmr::vector<Post> &posts) {
+        for (const auto &post : posts)
+            join.add(0, post);
+    });
+    hn.onPosts([&join](const std::pmr::vector<Post> &posts) {
+        for (const auto &post : posts)
+            join.add(1, post);
+    });
+
+    std::vector<task<json>> fetches;
+    fetches.push_back(lobster.getPosts());
+    fetches.push_back(hn.getPosts());
+    auto documents = Executor().run(whenAll(std::move(fetches)));
+    lobster.onPosts(nullptr);
+    hn.onPosts(nullptr);
+
+    // the history and the heavy hitters get the same posts and matches as a run without --stream
+    std::optional<PostTable> lobstersPosts;
+    std::optional<PostTable> hnPosts;
+    if (History().enabled() || Hitters().enabled())
+    {
+        lobstersPosts.emplace(lobster.parsePosts(documents[0], arena.resource()));
+        hnPosts.emplace(hn.parsePosts(documents[1], arena.resource()));
+        std::vector<postSection> sections {{std::string(lobster.shortName()), *lobstersPosts}, {std::string(hn.shortName()), *hnPosts}};
+        History().append(time(nullptr), Arguments().at(1), sections);
+        Hitters().addPosts(sections);
+        std::vector<sourceTable> sources {{lobster, *lobstersPosts}, {hn, *hnPosts}};
+        for (const auto &match : joinByUrl(sources))
+            Hitters().addMatch(sources, match);
+    }
+
+    std::cout << "\n";
+    printCompleteness(lobster, hn);
+    join.printSummary();
+    Hitters().finish();
+    return 0;
+}
+
+//The Lobsters and HN posts, fetched at the same time unless the Lobsters
+//depth depends on the HN posts. The arena is not thread safe, so both are
+//parsed here once their fetches are done.
+std::pair<PostTable, PostTable> fetchSources(lobsters &lobster, hackernews &hn, runArena &arena, const std::string &lobstersMessage)
+{
+    if (argumentFlag("adaptive-depth"))
+    {
+        PostTable hnPosts(Executor().run(hn.fetchPosts(arena.resource())));
+        if (hnPosts.size() > 0)
+        {
+            lobster.fetchUntil(oldestSubmission(hnPosts));
+            std::cout << "Fetching Lobsters pages async until they are older than the HN posts\n\n";
+        }
+        else
+            std::cout << lobstersMessage;
+        PostTable lobstersPosts(Executor().run(lobster.fetchPosts(arena.resource())));
+        return {std::move(lobstersPosts), std::move(hnPosts)};
+    }
+
+    std::cout << lobstersMessage;
+    std::vector<task<json>> fetches;
+    fetches.push_back(hn.getPosts());
+    fetches.push_back(lobster.getPosts());
+    auto documents = Executor().run(whenAll(std::move(fetches)));
+    PostTable hnPosts(hn.parsePosts(documents[0], arena.resource()));
+    PostTable lobstersPosts(lobster.parsePosts(documents[1], arena.resource()));
+    return {std::move(lobstersPosts), std::move(hnPosts)};
+}
+
+//compares the Lobsters posts against each of several HN lists, which are fetched together
+int compareLists(lobsters &lobster, hackernews &hn, std::vector<hackernews::listRequest> requests, runArena &arena, const analyzeOptions &options)
+{
+    std::cout << "Fetching HackerNews lists async (";
+    for (size_t i = 0; i < requests.size(); ++i)
+        std::cout << (i ? ", " : "") << requests[i].name << " " << requests[i].depth << " posts";
+    std::cout << ") (https://github.com/HackerNews/API)\n";
+    auto lists = Executor().run(hn.getLists(requests, arena.resource()));
+
+    PostTable allHnPosts(arena.resource());
+    for (const auto &list : lists)
+    {
+        for (const auto &post : list.posts)
+            allHnPosts.add(post);
+    }
+    if (argumentFlag("adaptive-depth") && allHnPosts.size() > 0)
+        lobster.fetchUntil(oldestSubmission(allHnPosts));
+    std::cout << "Fetching Lobsters pages async\n\n";
+    PostTable lobstersPosts(Executor().run(lobster.fetchPosts(arena.resource())));
+
+    std::vector<PostTable> listPosts;
+    listPosts.reserve(lists.size());
+    std::vector<postSection> sections {{std::string(lobster.shortName()), lobstersPosts}};
+    for (const auto &list : lists)
+        sections.push_back({std::string(hn.shortName()) + " " + list.name, listPosts.emplace_back(list.posts)});
+    History().append(time(nullptr), Arguments().at(1), sections);
+    Hitters().addPosts(sections);
+
+    printCompleteness(lobster, hn);
+    for (size_t list = 0; list < lists.size(); ++list)
+    {
+        std::cout << "## HackerNews " << lists[list].name << " stories\n\n";
+        analyze({{lobster, lobstersPosts}, {hn, listPosts[list]}}, options);
+    }
+    Hitters().finish();
+    if (Hedger().enabled())
+        Hedger().printStats();
+    return 0;
+}
+
+//After matching, re-fetches only the matched Lobsters stories and HN items
+//every interval and compares how fast their votes and comments grow on both
+//sites. The requests per round are two per match, whatever the list sizes.
+int trackMatches(lobsters &lobster, hackernews &hn, runArena &arena, std::chrono::milliseconds interval, int rounds)
+{
+    std::cout << "Fetching HackerNews Best Stories async (https://github.com/HackerNews/API)\n";
+    auto [lobstersPosts, hnPosts] = fetchSources(lobster, hn, arena, "Fetching the first ten Lobsters pages async (https://lobste.rs/s/r9oskz/is_there_api_documentation_for_lobsters_somewhere)\n\n");
+    printCompleteness(lobster, hn);
+
+    struct trackedPost
+    {
+        std::string title;
+        std::array<std::string, 2> ids;
+        std::array<velocitySeries, 2> series;
+    };
+    std::array<aggregator *, 2> sites {&lobster, &hn};
+    std::array<const PostTable *, 2> tables {&lobstersPosts, &hnPosts};
+    std::vector<trackedPost> tracked;
+    std::array<std::unordered_map<std::string, size_t>, 2> byId;
+    time_t fetched = time(nullptr);
+    for (const auto &match : joinByUrl({{lobster, lobstersPosts}, {hn, hnPosts}}))
+    {
+        trackedPost post;
+        for (size_t site = 0; site < sites.size(); ++site)
+        {
+            auto at = std::find_if(match.appearances.begin(), match.appearances.end(), [site](const appearance &at) { return at.source == site; });
+            if (at == match.appearances.end())
+                continue;
+            const PostTable &posts = *tables[site];
+            post.title = posts.title(at->row);
+            post.ids[site] = posts.id(at->row);
+            post.series[site].add({fetched, posts.votes(at->row), posts.comment_count(at->row)});
+        }
+        if (post.ids[0].empty() || post.ids[1].empty())
+            continue;
+        for (size_t site = 0; site < sites.size(); ++site)
+            byId[site].emplace(post.ids[site], tracked.size());
+        tracked.push_back(std::move(post));
+    }
+
+    std::cout << "Tracking the votes and comments of " << tracked.size() << " matched posts every " << interval.count() / 1000.0 << " seconds, "
+              << rounds << " times (" << 2 * tracked.size() << " requests per round)\n\n";
+    if (tracked.empty())
+        return 0;
+
+    // the posts of a round, released at the start of the next one
+    runArena roundArena(256 * 1024);
+    for (int round = 1; round <= rounds; ++round)
+    {
+        // a replay serves the recorded rounds right away
+        if (!Traffic().replaying())
+            std::this_thread::sleep_for(interval);
+        // the requests of the last round that missed its deadline end first
+        Executor().waitIdle();
+        Budget().restart();
+
+        std::vector<task<json>> fetches;
+        for (size_t site = 0; site < sites.size(); ++site)
+        {
+            std::vector<std::string> ids;
+            ids.reserve(tracked.size());
+            for (const auto &post : tracked)
+                ids.push_back(post.ids[site]);
+            fetches.push_back(sites[site]->getItems(std::move(ids)));
+        }
+        auto documents = Executor().run(whenAll(std::move(fetches)));
+
+        time_t now = time(nullptr);
+        roundArena.reset();
+        std::array<size_t, 2> updated {};
+        std::vector<PostTable> roundPosts;
+        roundPosts.reserve(sites.size());
+        for (size_t site = 0; site < sites.size(); ++site)
+        {
+            PostTable &posts = roundPosts.emplace_back(roundArena.resource());
+            for (const auto &document : documents[site])
+            {
+                for (const auto &post : sites[site]->parseDocument(document, roundArena.resource()))
+                {
+                    auto index = byId[site].find(std::string(post.id));
+                    if (index == byId[site].end())
+                        continue;
+                    tracked[index->second].series[site].add({now, post.votes, post.comment_count});
+                    posts.add(post);
+                    ++updated[site];
+                }
+            }
+        }
+        History().append(now, "track", {{std::string(lobster.shortName()), roundPosts[0]}, {std::string(hn.shortName()), roundPosts[1]}});
+        Metrics().writeTextfile();
+        std::cout << "Round " << round << ": updated " << updated[0] << " " << lobster.shortName() << " stories and " << updated[1] << " "
+                  << hn.shortName() << " items.\n";
+        printCompleteness(lobster, hn);
+    }
+    std::cout << "\n";
+
+    std::array<runningStats, 2> votesPerHour, commentsPerHour;
+    runningStats votesRatio;
+    size_t samples = 0;
+    size_t bytes = 0;
+    std::cout << std::fixed << std::setprecision(1);
+    for (const auto &post : tracked)
+    {
+        std::cout << "# " << post.title << "  \n";
+        std::array<std::optional<std::pair<double, double>>, 2> rates;
+        for (size_t site = 0; site < sites.size(); ++site)
+        {
+            const velocitySeries &series = post.series[site];
+            samples += series.size();
+            bytes += series.bytes();
+            rates[site] = series.perHour();
+            std::cout << sites[site]->name() << ": " << series.last().votes << " votes (" << std::showpos << series.last().votes - series.first().votes
+                      << std::noshowpos << ") and " << series.last().comments << " comments (" << std::showpos
+                      << series.last().comments - series.first().comments << std::noshowpos << ")";
+            if (rates[site])
+            {
+                std::cout << ", " << rates[site]->first << " votes and " << rates[site]->second << " comments per hour, at most "
+                          << series.peakVotesPerHour().value_or(0) << " votes per hour";
+                votesPerHour[site].add(rates[site]->first);
+                commentsPerHour[site].add(rates[site]->second);
+            }
+            std::cout << ".  \n";
+        }
+        if (rates[0] && rates[1] && rates[0]->first > 0)
+            votesRatio.add(rates[1]->first / rates[0]->first);
+        std::cout << "\n";
+    }
+
+    for (size_t site = 0; site < sites.size(); ++site)
+    {
+        if (votesPerHour[site].count() == 0)
+            continue;
+        std::cout << "Votes per hour on " << sites[site]->shortName() << ", p50: " << votesPerHour[site].percentile(0.5) << ", p90: "
+                  << votesPerHour[site].percentile(0.9) << ", mean: " << votesPerHour[site].mean() << "; comments per hour, p50: "
+                  << commentsPerHour[site].percentile(0.5) << ", p90: " << commentsPerHour[site].percentile(0.9) << ", mean: "
+                  << commentsPerHour[site].mean() << ".\n";
+    }
+    if (votesRatio.count() > 0)
+        std::cout << "Vote growth on " << hn.shortName() << " relative to " << lobster.shortName() << ", p50: " << votesRatio.percentile(0.5)
+                  << "x, p90: " << votesRatio.percentile(0.9) << "x.\n";
+    std::cout << "Kept " << samples << " samples in " << bytes << " bytes (" << static_cast<double>(bytes) / samples << " bytes per sample).\n";
+    std::cout << std::defaultfloat << std::setprecision(6);
+    return 0;
+}
+
+//Maps the column files of the history and counts the urls that were seen on
+//more than one site, without parsing anything. HN lists count as HN.
+int summarizeHistory()
+{
+    if (!History().enabled())
+    {
+        std::cout << "The history command needs --history=dir.\n";
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto runs = History().columns();
+    auto mapped = std::chrono::steady_clock::now();
+
+    std::vector<std::string> sourceNames;
+    std::unordered_map<uint64_t, uint32_t> urlSources; // bit per site
+    size_t posts = 0;
+    for (const auto &run : runs)
+    {
+        std::vector<uint32_t> bits(run.sources());
+        for (size_t source = 0; source < run.sources(); ++source)
+        {
+            auto name = run.sourceName(source);
+            name = name.substr(0, name.find(' '));
+            auto known = std::find(sourceNames.begin(), sourceNames.end(), name);
+            if (known == sourceNames.end() && sourceNames.size() < 32)
+                known = sourceNames.emplace(known, name);
+            bits[source] = known == sourceNames.end() ? 0 : 1u << (known - sourceNames.begin());
+        }
+        urlSources.reserve(urlSources.size() + run.size());
+        for (size_t row = 0; row < run.size(); ++row)
+            urlSources[run.urlHash(row)] |= bits[run.source(row)];
+        posts += run.size();
+    }
+    auto scanned = std::chrono::steady_clock::now();
+
+    size_t crossPosted = std::count_if(urlSources.cbegin(), urlSources.cend(), [](const auto &url) { return std::popcount(url.second) >= 2; });
+    auto ms = [](auto duration) { return std::chrono::duration<double, std::milli>(duration).count(); };
+    std::cout << std::fixed << std::setprecision(1);
+    size_t indexed = History().index().size();
+    std::cout << "The snapshot index lists " << indexed << " runs.\n";
+    std::cout << "Mapped " << runs.size() << " runs with " << posts << " posts in " << ms(mapped - start) << " ms, read them in " << ms(scanned - mapped) << " ms.\n";
+    std::cout << urlSources.size() << " distinct urls, " << crossPosted << " of them on more than one of";
+    for (size_t i = 0; i < sourceNames.size(); ++i)
+        std::cout << (i ? ", " : " ") << sourceNames[i];
+    std::cout << ".\n\n";
+    Hitters().printTop(Hitters().topK() > 0 ? Hitters().topK() : 10);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    for (int i = 0; i < argc; ++i)
+    {
+        Arguments().push_back(argv[i]);
+    }
+
+    // a stopped or server closed connection must give an error, not end the program
+    std::signal(SIGPIPE, SIG_IGN);
+
+    // resolve and connect to both upstreams while the banner is printed
+    std::future<void> warmUp;
+    bool fetching = Arguments().size() >= 2 && (Arguments().at(1) == "top" || Arguments().at(1) == "new" || Arguments().at(1) == "track");
+    if (fetching && argumentValue("replay").empty())
+        warmUp = std::async(std::launch::async, [] { Connections().warmUp({"hacker-news.firebaseio.com", "lobste.rs"}, 2); });
+
+#ifndef __GNUG__
+    std::cout << "Please use GCC to compile, we're using it's struct tm tm_gmtoff extension.";
+    return 1;
 #endif
 
     std::cout << "Which stories appear both on Lobsters and on HN, who was first?\n";
@@ -503,8 +5228,81 @@ int main(int argc, char *argv[])
 
     printCurrentDate();
 
+    size_t hnDepth = 200;
+    std::chrono::milliseconds interval = std::chrono::minutes(5);
+    int rounds = 12;
+    analyzeOptions options;
+    options.matchTitles = argumentFlag("match-titles");
+    std::vector<hackernews::listRequest> hnLists;
+    try
+    {
+        if (auto dir = argumentValue("record"); !dir.empty())
+        {
+            Traffic().startRecording(dir);
+            std::cout << "Recording upstream responses to " << dir << "\n\n";
+        }
+        if (auto dir = argumentValue("replay"); !dir.empty())
+        {
+            Traffic().startReplaying(dir);
+            std::cout << "Replaying upstream responses from " << dir << "\n\n";
+        }
+        if (auto budget = argumentValue("budget"); !budget.empty())
+            Budget().start(runBudget::parse(budget, "budget"));
+        if (auto rate = argumentValue("rate"); !rate.empty())
+            Limiter().setRate(std::stod(rate));
+        if (auto depth = argumentValue("hn-depth"); !depth.empty())
+            hnDepth = std::stoul(depth);
+        if (auto horizon = argumentValue("horizon"); !horizon.empty())
+            options.horizon = parseHorizon(horizon);
+        if (auto lists = argumentValue("hn-lists"); !lists.empty())
+            hnLists = parseHnLists(lists, hnDepth);
+        if (argumentFlag("stream") && (options.matchTitles || options.horizon || argumentFlag("adaptive-depth") || !hnLists.empty()))
+            throw std::invalid_argument("--stream matches by url as the posts arrive, it can't be combined with --match-titles, --horizon, --adaptive-depth or --hn-lists");
+        if (auto dir = argumentValue("history"); !dir.empty())
+        {
+            History().start(dir);
+            Hitters().start(dir);
+        }
+        if (auto k = argumentValue("top-k"); !k.empty())
+            Hitters().showTop(std::stoul(k));
+        if (auto file = argumentValue("metrics"); !file.empty())
+            Metrics().exportTo(file);
+        if (auto every = argumentValue("interval"); !every.empty())
+            interval = runBudget::parse(every, "interval");
+        if (auto count = argumentValue("rounds"); !count.empty())
+            rounds = std::stoi(count);
+    }
+    catch (const std::exception &e)
+    {
+        std::cout << e.what() << "\n";
+        return 1;
+    }
+
+    if (argumentFlag("hedge"))
+        Hedger().enable();
+
+    // the metrics of the run, whichever command returns
+    struct metricsTextfile
+    {
+        ~metricsTextfile() { Metrics().writeTextfile(); }
+    } metricsTextfile;
+
+    // requests that missed the run deadline are still ending, they use
+    // statics (httplib's among them) that go away once main returns
+    struct requestsDone
+    {
+        bool fetching;
+        ~requestsDone()
+        {
+            if (!fetching)
+                return;
+            Executor().waitIdle();
+        }
+    } requestsDone {fetching};
+
     auto lobster = lobsters("lobste.rs", "/page/%PAGENUMBER%.json");
-    auto hn = hackernews("hacker-news.firebaseio.com", "/v0/beststories.json", "/v0/item/%ID%.json");
+    auto hn = hackernews("hacker-news.firebaseio.com", "/v0/beststories.json", "/v0/item/%ID%.json", hnDepth);
+    runArena arena;
 
     if (Arguments().size() >= 2 && Arguments().at(1) == "help")
     {
@@ -512,18 +5310,34 @@ int main(int argc, char *argv[])
         return 0;
     }
 
+    if (Arguments().size() >= 2 && Arguments().at(1) == "history")
+        return summarizeHistory();
+
+    if (Arguments().size() >= 2 && Arguments().at(1) == "track")
+        return trackMatches(lobster, hn, arena, interval, rounds);
+
     if (Arguments().size() >= 2 && Arguments().at(1) == "new")
     {
         lobster = lobsters("lobste.rs", "/newest/page/%PAGENUMBER%.json");
-        hn = hackernews("hacker-news.firebaseio.com", "/v0/newstories.json", "/v0/item/%ID%.json");
+        hn = hackernews("hacker-news.firebaseio.com", "/v0/newstories.json", "/v0/item/%ID%.json", hnDepth);
 
-        std::cout << "Fetching HackerNews New Stories async (200 posts) (https://github.com/HackerNews/API)\n";
-        std::vector<Post> hnPosts = hn.parsePosts(hn.getPosts());
+        if (!hnLists.empty())
+            return compareLists(lobster, hn, hnLists, arena, options);
 
-        std::cout << "Fetching the first ten Lobsters pages (/newest) async 10*25=200 posts) (https://lobste.rs/s/r9oskz/is_there_api_documentation_for_lobsters_somewhere)\n\n";
-        std::vector<Post> lobstersPosts = lobster.parsePosts(lobster.getPosts());
+        if (argumentFlag("stream"))
+            return streamSources(lobster, hn, arena);
 
-        analyze(lobstersPosts, hnPosts);
+        std::cout << "Fetching HackerNews New Stories async (" << hnDepth << " posts) (https://github.com/HackerNews/API)\n";
+        auto [lobstersPosts, hnPosts] = fetchSources(lobster, hn, arena, "Fetching the first ten Lobsters pages (/newest) async 10*25=200 posts) (https://lobste.rs/s/r9oskz/is_there_api_documentation_for_lobsters_somewhere)\n\n");
+        std::vector<postSection> sections {{std::string(lobster.shortName()), lobstersPosts}, {std::string(hn.shortName()), hnPosts}};
+        History().append(time(nullptr), Arguments().at(1), sections);
+        Hitters().addPosts(sections);
+
+        printCompleteness(lobster, hn);
+        analyze({{lobster, lobstersPosts}, {hn, hnPosts}}, options);
+        Hitters().finish();
+        if (Hedger().enabled())
+            Hedger().printStats();
         return 0;
     }
 
@@ -539,9 +5353,218 @@ int main(int argc, char *argv[])
         std::string lobsters_test_json = "[[{\"short_id\":\"4pivy1\",\"short_id_url\":\"https://lobste.rs/s/4pivy1\",\"created_at\":\"2020-12-27T06:58:40.000-06:00\",\"title\":\"Bash HTTP monitoring dashboard\",\"url\":\"https://raymii.org/s/software/Bash_HTTP_Monitoring_Dashboard.html\",\"score\":30,\"flags\":0,\"comment_count\":2,\"description\":\"\",\"comments_url\":\"https://lobste.rs/s/4pivy1/bash_http_monitoring_dashboard\",\"submitter_user\":{\"username\":\"raymii\",\"created_at\":\"2013-11-20T11:58:43.000-06:00\",\"is_admin\":false,\"about\":\"https://raymii.org\",\"is_moderator\":false,\"karma\":7351,\"avatar_url\":\"/avatars/raymii-100.png\",\"invited_by_user\":\"journeysquid\"},\"tags\":[\"linux\",\"web\"],\"comments\":[{\"short_id\":\"zdonpb\",\"short_id_url\":\"https://lobste.rs/c/zdonpb\",\"created_at\":\"2020-12-28T06:50:10.000-06:00\",\"updated_at\":\"2020-12-28T06:51:33.000-06:00\",\"is_deleted\":false,\"is_moderated\":false,\"score\":2,\"flags\":0,\"comment\":\"\\u003cp\\u003eThanks Remy, I enjoyed reading through the shell script source, which inspired me to write a \\u003ca href=\\\"https://lobste.rs/s/2ougg7/waiting_for_jobs_concept_shell\\\" rel=\\\"ugc\\\"\\u003epost about \\u003ccode\\u003ewait\\u003c/code\\u003e, and about shell scripting\\u003c/a\\u003e today.\\u003c/p\\u003e\\n\",\"url\":\"https://lobste.rs/s/4pivy1/bash_http_monitoring_dashboard#c_zdonpb\",\"indent_level\":1,\"commenting_user\":{\"username\":\"qmacro\",\"created_at\":\"2020-01-24T10:48:42.000-06:00\",\"is_admin\":false,\"about\":\"[Developer, author, teacher, speaker](https://qmacro.org). And fascinated by all sorts of stuff.\",\"is_moderator\":false,\"karma\":79,\"avatar_url\":\"/avatars/qmacro-100.png\",\"invited_by_user\":\"martinrue\",\"github_username\":\"qmacro\",\"twitter_username\":\"qmacro\"}},{\"short_id\":\"lalafr\",\"short_id_url\":\"https://lobste.rs/c/lalafr\",\"created_at\":\"2020-12-28T08:38:37.000-06:00\",\"updated_at\":\"2020-12-28T08:38:37.000-06:00\",\"is_deleted\":false,\"is_moderated\":false,\"score\":3,\"flags\":0,\"comment\":\"\\u003cp\\u003eThat is a great post, fun to read. I like such posts with backstory and musings. Often unable to write those myself, I’d rather stick to guides.\\u003c/p\\u003e\\n\\u003cp\\u003eSubscribed to your rss feed as well.\",\"url\":\"https://lobste.rs/s/4pivy1/bash_http_monitoring_dashboard#c_lalafr\",\"indent_level\":2,\"commenting_user\":{\"username\":\"raymii\",\"created_at\":\"2013-11-20T11:58:43.000-06:00\",\"is_admin\":false,\"about\":\"https://raymii.org\",\"is_moderator\":false,\"karma\":7351,\"avatar_url\":\"/avatars/raymii-100.png\",\"invited_by_user\":\"journeysquid\"}}]}]]";
         std::string hn_test_json = "[{\"by\":\"todsacerdoti\",\"descendants\":26,\"id\":25550732,\"kids\":[25551346,25551828,25552963,25556255,25552339,25559309,25554106,25553520,25552809,25557037],\"score\":154,\"time\":1609074256,\"title\":\"Bash HTTP Monitoring Dashboard\",\"type\":\"story\",\"url\":\"https://raymii.org/s/software/Bash_HTTP_Monitoring_Dashboard.html\"}]";
 
-        std::vector<Post> test_hnPosts = hn.parsePosts(json::parse(hn_test_json));
-        std::vector<Post> test_lobstersPosts = lobster.parsePosts(json::parse(lobsters_test_json));
-        analyze(test_lobstersPosts, test_hnPosts);
+        json hn_test_dom = json::parse(hn_test_json);
+        json lobsters_test_dom = json::parse(lobsters_test_json);
+        PostTable test_hnPosts(hn.parsePosts(hn_test_dom, arena.resource()));
+        PostTable test_lobstersPosts(lobster.parsePosts(lobsters_test_dom, arena.resource()));
+        // the same extraction on a DOM that counts its allocations
+        countingJson hn_counted_dom = countingJson::parse(hn_test_json);
+        countingJson lobsters_counted_dom = countingJson::parse(lobsters_test_json);
+        size_t domCopies = 0;
+        {
+            jsonAllocationCounter parseAllocations;
+            hackernews::extractPosts(hn_counted_dom, arena.resource());
+            lobsters::extractPosts(lobsters_counted_dom, arena.resource());
+            domCopies = parseAllocations.allocations();
+        }
+        analyze({{lobster, test_lobstersPosts}, {hn, test_hnPosts}});
+
+        std::cout << "\njson allocations while extracting posts: " << domCopies << " (should be 0, the DOM must not be copied).\n";
+
+        // the same story behind an archive link must still be found by its title
+        json hn_mirror_dom = json::parse(hn_test_json);
+        hn_mirror_dom[0]["url"] = "https://web.archive.org/web/2020/https://raymii.org/s/software/Bash_HTTP_Monitoring_Dashboard.html";
+        PostTable test_mirrorPosts(hn.parsePosts(hn_mirror_dom, arena.resource()));
+        size_t titleMatches = matchByTitle(test_lobstersPosts, test_mirrorPosts, {}).size();
+        std::cout << "title matches with a different url: " << titleMatches << " (should be 1).\n";
+        // the two posts are 5 minutes and 36 seconds apart
+        size_t titleMatchesWithinMinute = matchByTitle(test_lobstersPosts, test_mirrorPosts, {}, std::chrono::minutes(1)).size();
+        std::cout << "title matches with a different url within a 1 minute horizon: " << titleMatchesWithinMinute << " (should be 0).\n";
+        bool passed = domCopies == 0 && titleMatches == 1 && titleMatchesWithinMinute == 0;
+        auto check = [&passed](const std::string &what, const std::string &got, const std::string &expected) {
+            std::cout << what << ": " << got << " (should be " << expected << ").\n";
+            passed = passed && got == expected;
+        };
+
+        // the same url resubmitted on both sites 400 days later is a second
+        // cross-post with a 30 day horizon, and part of the first without one
+        json lobsters_resubmitted_dom = json::parse(lobsters_test_json);
+        json lobsters_resubmission = lobsters_resubmitted_dom[0][0];
+        lobsters_resubmission["short_id"] = "4pivy2";
+        lobsters_resubmission["created_at"] = "2022-01-31T06:58:40.000-06:00";
+        lobsters_resubmitted_dom[0].push_back(lobsters_resubmission);
+        json hn_resubmitted_dom = json::parse(hn_test_json);
+        json hn_resubmission = hn_resubmitted_dom[0];
+        hn_resubmission["id"] = 30150732;
+        hn_resubmission["time"] = 1609074256 + 400 * 24 * 60 * 60;
+        hn_resubmitted_dom.push_back(hn_resubmission);
+        PostTable test_lobstersResubmitted(lobster.parsePosts(lobsters_resubmitted_dom, arena.resource()));
+        PostTable test_hnResubmitted(hn.parsePosts(hn_resubmitted_dom, arena.resource()));
+        auto describeJoin = [&](std::optional<std::chrono::seconds> horizon) {
+            std::vector<sourceTable> sources {{lobster, test_lobstersResubmitted}, {hn, test_hnResubmitted}};
+            std::string described;
+            for (const auto &match : joinByUrl(sources, horizon))
+            {
+                described += described.empty() ? "" : ", ";
+                for (const auto &at : match.appearances)
+                    described += std::string(sources[at.source].posts.id(at.row)) + (&at == &match.appearances.back() ? "" : " ");
+            }
+            return described;
+        };
+        check("cross-posts of a url resubmitted outside the horizon", describeJoin(std::chrono::hours(30 * 24)), "4pivy1 25550732, 4pivy2 30150732");
+        check("cross-posts of a url resubmitted without a horizon", describeJoin(std::nullopt), "4pivy1 25550732");
+
+        // a column file maps back to the posts it was encoded from, and a
+        // header or source that does not fit the file is refused on opening
+        std::vector<postSection> testSections {{"lobsters", test_lobstersPosts}, {"hackernews", test_hnPosts}};
+        std::string columns = encodeColumns(1000, testSections);
+        auto columnFile = std::filesystem::temp_directory_path() / ("hn_lob_comp_test_" + std::to_string(::getpid()) + ".cols");
+        auto mapColumns = [&columnFile](const std::string &contents) -> std::string {
+            std::ofstream(columnFile, std::ios::binary | std::ios::trunc) << contents;
+            try
+            {
+                mappedPostTable mapped(columnFile);
+                size_t last = mapped.size() - 1;
+                return std::to_string(mapped.size()) + " rows, " + std::string(mapped.sourceName(mapped.source(last))) + " " + std::string(mapped.id(last)) + " " + std::string(mapped.original_url(last));
+            }
+            catch (const std::exception &)
+            {
+                return "refused";
+            }
+        };
+        size_t lastHn = test_hnPosts.size() - 1;
+        check("column file round trip", mapColumns(columns),
+              std::to_string(test_lobstersPosts.size() + test_hnPosts.size()) + " rows, hackernews " + std::string(test_hnPosts.id(lastHn)) + " " + std::string(test_hnPosts.original_url(lastHn)));
+        std::string corrupt = columns;
+        uint64_t hugeRows = uint64_t(1) << 61;
+        std::memcpy(corrupt.data() + offsetof(columnHeader, rows), &hugeRows, sizeof(hugeRows));
+        check("column file with too many rows", mapColumns(corrupt), "refused");
+        corrupt = columns;
+        uint32_t badSource = 2;
+        std::memcpy(corrupt.data() + columnLayout(test_lobstersPosts.size() + test_hnPosts.size(), 2, 0).source, &badSource, sizeof(badSource));
+        check("column file with an unknown source", mapColumns(corrupt), "refused");
+        std::filesystem::remove(columnFile);
+
+        // "d" is evicted by "e", whose count then includes the count of "d"
+        // as its error. Merging adds the lowest count of the full summary to
+        // the keys it is missing.
+        spaceSaving summary(4);
+        for (auto key : {"a", "a", "a", "a", "a", "b", "b", "b", "c", "c", "d", "e"})
+            summary.add(key);
+        spaceSaving otherSummary(4);
+        otherSummary.add("a", 2);
+        otherSummary.add("f", 4);
+        auto describe = [](const std::vector<spaceSaving::counter> &counters) {
+            std::string described;
+            for (const auto &counted : counters)
+            {
+                described += (described.empty() ? "" : ", ") + counted.key + " " + std::to_string(counted.count);
+                if (counted.error)
+                    described += " (error " + std::to_string(counted.error) + ")";
+            }
+            return described;
+        };
+        check("space-saving counts", describe(summary.top(4)), "a 5, b 3, c 2, e 2 (error 1)");
+        summary.merge(otherSummary);
+        check("space-saving counts after a merge", describe(summary.top(3)), "a 7, f 6 (error 2), b 3");
+
+        // "b" is first on lobsters for 2 of 3 cross-posts, "a" for 1 of 4 and
+        // "c" has too few cross-posts to rank by share.
+        heavyHitters hitters;
+        for (auto [key, site] : {std::pair {"a", "lobsters"}, {"a", "hackernews"}, {"a", "hackernews"}, {"a", "hackernews"}, {"b", "lobsters"}, {"b", "lobsters"}, {"b", "hackernews"}, {"c", "lobsters"}})
+            hitters.addCrossPost(key, site);
+        std::string byShare;
+        for (const auto &top : hitters.topFirstOn("lobsters", 3, 3))
+            byShare += top.key;
+        check("heavy hitters by share first on a site", byShare, "ba");
+
+        countMinSketch sketch;
+        countMinSketch otherSketch;
+        sketch.add("x", 3);
+        sketch.add("y");
+        otherSketch.add("x", 2);
+        sketch.merge(otherSketch);
+        check("count-min estimates after a merge", std::to_string(sketch.estimate("x")) + ", " + std::to_string(sketch.estimate("y")) + ", " + std::to_string(sketch.estimate("z")), "5, 1, 0");
+
+        // deltas that go down and deltas that need several varint bytes
+        velocitySeries series;
+        for (const velocitySeries::sample &sample : std::vector<velocitySeries::sample> {{1609074256, 154, 26}, {1609074556, 150, 26}, {1609078156, 40000, 3}, {1609074256, -70000, 0}})
+            series.add(sample);
+        std::string decoded;
+        for (const auto &sample : series.samples())
+            decoded += (decoded.empty() ? "" : ", ") + std::to_string(sample.time) + " " + std::to_string(sample.votes) + " " + std::to_string(sample.comments);
+        check("velocity samples decoded", decoded, "1609074256 154 26, 1609074556 150 26, 1609078156 40000 3, 1609074256 -70000 0");
+
+        // a Retry-After too large for any integer is a delay too long to retry after
+        auto retryAfter = [](const std::string &value) { return std::to_string(retryPolicy::parseRetryAfter({{"Retry-After", value}})->count()); };
+        check("retry-after seconds", retryAfter("120") + ", " + retryAfter("99999999999999999999999") + ", " + retryAfter("9223372036854776"),
+              "120000, " + std::to_string(std::chrono::milliseconds::max().count()) + ", " + std::to_string(std::chrono::milliseconds::max().count()));
+
+        // two halves merged must give the percentiles (within 1%), mean and variance of the whole
+        runningStats evens;
+        runningStats odds;
+        std::vector<double> values;
+        for (int i = 1; i <= 1000; ++i)
+        {
+            double value = std::pow(1.01, i % 700) * (i % 5 == 0 ? -1 : 1);
+            values.push_back(value);
+            (i % 2 ? odds : evens).add(value);
+        }
+        evens.merge(odds);
+        std::sort(values.begin(), values.end());
+        double mean = std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+        double squares = 0;
+        for (double value : values)
+            squares += (value - mean) * (value - mean);
+        double variance = squares / (values.size() - 1);
+        bool percentilesClose = true;
+        for (double fraction : {0.01, 0.1, 0.5, 0.9, 0.99})
+        {
+            double exact = values[static_cast<size_t>(fraction * (values.size() - 1))];
+            percentilesClose = percentilesClose && std::abs(evens.percentile(fraction) - exact) <= 0.01 * std::abs(exact) + 1e-12;
+        }
+        check("merged percentiles within 1% of the exact ones", percentilesClose ? "yes" : "no", "yes");
+        check("merged count, mean and variance equal the exact ones",
+              evens.count() == values.size() && std::abs(evens.mean() - mean) < 1e-9 && std::abs(evens.variance() - variance) < 1e-9 * variance ? "yes" : "no", "yes");
+
+        // a match is reported once, when its second source arrives. An update
+        // replaces what the url adds to the totals, a second post with the
+        // same url is ignored and on the same second the first source wins.
+        auto testPost = [](const std::string &id, const std::string &url, time_t submitted, int votes, int comments) {
+            Post post;
+            post.id = id;
+            post.title = "title " + id;
+            post.original_url = url;
+            post.submit_timestamp = submitted;
+            post.votes = votes;
+            post.comment_count = comments;
+            return post;
+        };
+        std::vector<std::string_view> joinNames {"A", "B"};
+        std::string joined;
+        incrementalJoin join(joinNames, [&joined, &joinNames](const incrementalJoin::matchRecord &match) {
+            joined += (joined.empty() ? "" : ", ") + std::string(match.url) + " " + std::string(joinNames[match.firstSource]) + " then " + std::string(joinNames[match.laterSource]) + " after " + std::to_string(match.after);
+        });
+        join.add(0, testPost("1", "u1", 1000, 10, 3));
+        join.add(1, testPost("2", "u1", 400, 21, 4));
+        join.add(1, testPost("2", "u1", 400, 25, 4));
+        join.add(0, testPost("3", "u2", 50, 4, 0));
+        join.add(1, testPost("4", "u2", 50, 6, 1));
+        join.add(1, testPost("5", "u2", 10, 100, 100));
+        check("streamed matches", joined, "u1 B then A after 600, u2 A then B after 0");
+        std::ostringstream printed;
+        auto console = std::cout.rdbuf(printed.rdbuf());
+        join.printSummary();
+        std::cout.rdbuf(console);
+        std::string summaryLines = printed.str();
+        std::replace(summaryLines.begin(), summaryLines.end(), '\n', ' ');
+        check("streamed summary", summaryLines, "2 matches. 1 posts appeared first on A and 1 posts appeared first on B. Average time for a cross-post: 5 minutes, . Average comments on B: 2.5, A: 1.5. Average score on B: 15.5, A: 7.0. ");
+
+        if (!passed)
+        {
+            std::cout << "--- TEST FAILED ---\n";
+            return 1;
+        }
 
         std::cout << "--- END TEST ---\n\n";
         return 0;
@@ -549,13 +5572,23 @@ int main(int argc, char *argv[])
 
     if (Arguments().size() >= 2 && Arguments().at(1) == "top")
     {
-        std::cout << "Fetching HackerNews Best Stories async (200 posts) (https://github.com/HackerNews/API)\n";
-        std::vector<Post> hnPosts = hn.parsePosts(hn.getPosts());
+        if (!hnLists.empty())
+            return compareLists(lobster, hn, hnLists, arena, options);
+
+        if (argumentFlag("stream"))
+            return streamSources(lobster, hn, arena);
 
-        std::cout << "Fetching the first ten Lobsters pages async 10*25=200 posts) (https://lobste.rs/s/r9oskz/is_there_api_documentation_for_lobsters_somewhere)\n\n";
-        std::vector<Post> lobstersPosts = lobster.parsePosts(lobster.getPosts());
+        std::cout << "Fetching HackerNews Best Stories async (" << hnDepth << " posts) (https://github.com/HackerNews/API)\n";
+        auto [lobstersPosts, hnPosts] = fetchSources(lobster, hn, arena, "Fetching the first ten Lobsters pages async 10*25=200 posts) (https://lobste.rs/s/r9oskz/is_there_api_documentation_for_lobsters_somewhere)\n\n");
+        std::vector<postSection> sections {{std::string(lobster.shortName()), lobstersPosts}, {std::string(hn.shortName()), hnPosts}};
+        History().append(time(nullptr), Arguments().at(1), sections);
+        Hitters().addPosts(sections);
 
-        analyze(lobstersPosts, hnPosts);
+        printCompleteness(lobster, hn);
+        analyze({{lobster, lobstersPosts}, {hn, hnPosts}}, options);
+        Hitters().finish();
+        if (Hedger().enabled())
+            Hedger().printStats();
         return 0;
     }
 